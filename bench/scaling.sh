@@ -0,0 +1,57 @@
+#!/bin/bash
+#
+# Scaling benchmark of the DAMM sampler on synthetic data
+#
+# Generates SIZES observations with benchData, then times main on each data set; every command is echoed as run.
+# Both binaries are expected at the repository root, where the CMake build places them.
+#
+#   SIZES    observation counts              (default "1000000 10000000")
+#   ITER     Gibbs iterations per run        (default 30)
+#   MOVES    split/merge schedule of main    (default splits at t = 5, 15, 25 and merges at t = 10, 20, 30)
+#   THREADS  threads of main, 0 for all      (default 0)
+#   OUT      data and log directory          (default build/bench)
+#   KEEP     keep the generated data when 1  (default 0)
+#
+# The data holds 20 strokes while main starts from 5 components, so the moves have to run for the number of
+# components to grow; main reports the time of the moves and of the Gibbs sweeps apart, and its total time also
+# includes parsing the input.
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SIZES=${SIZES:-"1000000 10000000"}
+ITER=${ITER:-30}
+MOVES=${MOVES:-"--split-start 5 --split-every 10 --merge-start 10 --merge-every 10"}
+THREADS=${THREADS:-0}
+OUT=${OUT:-$ROOT/build/bench}
+KEEP=${KEEP:-0}
+
+mkdir -p "$OUT"
+now() { date +%s.%N; }
+elapsed() { awk -v a="$1" -v b="$2" 'BEGIN {printf "%.2f", b - a}'; }
+reported() { grep "$1" "$2" | tail -1 | awk '{printf "%.2f", $(NF-1)}'; }
+
+results=()
+for N in $SIZES; do
+    DATA="$OUT/damm_$N.txt"
+    LOG="$OUT/main_$N.log"
+    GEN="$ROOT/benchData --points $N --components 20 --dim 3 --seed 1"
+    RUN="$ROOT/main --base 0 --init 5 --iter $ITER --alpha 1 --seed 42 --threads $THREADS $MOVES --log $OUT"
+
+    echo "+ $GEN > $DATA"
+    t0=$(now)
+    $GEN > "$DATA"
+    t1=$(now)
+
+    echo "+ $RUN < $DATA"
+    $RUN < "$DATA" > "$LOG"
+    t2=$(now)
+
+    K=$(grep "Number of components" "$LOG" | tail -1 | awk '{print $NF}')
+    results+=("$(printf "%-10s %12s %12s %12s %12s %12s" "$N" "$(elapsed $t0 $t1)" "$(elapsed $t1 $t2)" \
+        "$(reported "Time in Gibbs sweeps" "$LOG")" "$(reported "Time in split/merge moves" "$LOG")" "$K")")
+    [ "$KEEP" = 1 ] || rm -f "$DATA"
+done
+
+printf "%-10s %12s %12s %12s %12s %12s\n" points generate_s main_s sweeps_s moves_s components
+printf "%s\n" "${results[@]}"
@@ -1,8 +1,12 @@
 #pragma once
 
-#include <boost/random/mersenne_twister.hpp>
 #include <Eigen/Dense>
+#include "philox.hpp"
 #include "gaussDamm.hpp"
+#include "logLikEngine.hpp"
+#include "execution.hpp"
+#include "suffStats.hpp"
+#include "dpmm.hpp"
 
 using namespace Eigen;
 using namespace std;
@@ -15,8 +19,8 @@ class Damm
     /*---------------------------------------------------*/
     //-------------Constructor & Desctructor--------------
     /*---------------------------------------------------*/
-    Damm(const MatrixXd &x, int init_cluster, double alpha, const dist_t &H, const boost::mt19937 &rndGen);
-    Damm(const MatrixXd &x, int init_cluster, double alpha, const dist_t &H, const boost::mt19937 &rndGen, VectorXi z);
+    Damm(const MatrixXd &x, int init_cluster, double alpha, const dist_t &H, uint64_t seed);
+    Damm(const MatrixXd &x, int init_cluster, double alpha, const dist_t &H, uint64_t seed, VectorXi z);
     Damm(){};
     ~Damm(){};
 
@@ -31,26 +35,55 @@ class Damm
     /*---------------------------------------------------*/
     //----------------Split/Merge Proposal----------------
     /*---------------------------------------------------*/
-    int splitProposal(const vector<int> &indexList);
-    int mergeProposal(const vector<int> &indexList_i, const vector<int> &indexList_j);
+    int splitProposal(IndexView indexList);
+    int splitProposals(const Membership &indexLists, uint32_t minSize, uint32_t maxProposals = 0, 
+      uint32_t *numProposed = nullptr);
+    int mergeProposal(IndexView indexList_i, IndexView indexList_j);
+    int mergeProposals(uint32_t maxProposals, int similarity, uint32_t minSize, uint32_t maxAccepted, 
+      uint32_t *numProposed = nullptr);
+    int subClusterSplits();
 
     /*---------------------------------------------------*/
     //----------------Incremental Learning----------------
     /*---------------------------------------------------*/
     void sampleLabels_increm();
 
+    /*---------------------------------------------------*/
+    //-----------------Mixed Precision--------------------
+    /*---------------------------------------------------*/
+    void setPrecision(bool mixed);
+    double labelAgreement();
+
     /*---------------------------------------------------*/
     //---------------------Utilities---------------------
     /*---------------------------------------------------*/  
     void reorderAssignments();
     void updateIndexLists();
-    vector<vector<int>> getIndexLists();
-    const VectorXi & getLabels(){return z_;};
+    const Membership & getIndexLists();
+    VectorXi getLabels() const;
     int getK(){return K_;};
+    void setExecution(const ExecutionContext &exec){exec_ = exec;};
+    void setGrouping(bool grouped);
+    void setStatsMode(StatsMode mode, uint32_t refresh = 0){statsMode_ = mode; stats_.setRefresh(refresh); subStats_.setRefresh(refresh);};
+    void setLaunch(const LaunchOptions &opt){launch_ = opt;};
+    void setSubClusters(bool enabled, uint32_t burnIn = 5);
+    const vector<int> & getLogScans(){return logScans_;};
+    void setLogLikTracking(bool track){trackLogLik_ = track;};
+    const vector<double> & getLogLogLik(){return logLogLik_;};
     vector<array<int, 2>>  computeSimilarity(int mergeNum, int mergeIdx);
 
   private:
-    double KL_div(const MatrixXd& Sigma_p, const MatrixXd& Sigma_q, const MatrixXd& mu_p, const MatrixXd& mu_q);
+    double KL_div(const LLT<MatrixXd>& chol_p, const LLT<MatrixXd>& chol_q, const VectorXd& mu_p, const VectorXd& mu_q);
+    void packEngineF();
+    bool proposeSplit(IndexView indexList, uint64_t seed, const ExecutionContext &exec, 
+      vector<int> &indexList_i, vector<int> &indexList_j, double &logAcceptanceRatio, uint32_t &numScans) const;
+    void acceptSplit(IndexView indexList_i, IndexView indexList_j, double logAcceptanceRatio);
+    void initSubClusters(IndexView indexList, uint32_t k, uint64_t seed);
+    void mergeSubClusters(IndexView indexList_i, IndexView indexList_j, uint32_t k);
+    void sampleSubClusterParameters();
+    void reorderRows(const vector<int> &order);
+    template <typename T> void sweepLabels(const LogLikEngine<T> &engine, const Matrix<T,Dynamic,Dynamic> &x);
+    template <typename T> void sweepLabels_increm(const LogLikEngine<T> &engine, const Matrix<T,Dynamic,Dynamic> &x);
 
 
   private:
@@ -58,7 +91,9 @@ class Damm
     uint32_t dim_;
     double alpha_; 
     dist_t H_; 
-    boost::mt19937 rndGen_;
+    uint64_t seed_;
+    uint32_t stream_ = 0;   // Philox stream tag, advanced once per random phase
+    ExecutionContext exec_;
 
     //class initializer(dependent on data)
     MatrixXd x_;
@@ -66,21 +101,53 @@ class Damm
     MatrixXd xDir_;
     VectorXi z_;   
     VectorXd Pi_;  
-    uint16_t N_;
-    uint16_t K_;
+    uint32_t N_;
+    uint32_t K_;
 
     //sampled parameters
     vector<dist_t> parameters_ ;     
-    vector<gaussDamm<double>> components_;      
+    vector<typename dist_t::component_t> components_;      
+    LogLikEngine<double> engine_;
+
+    //mixed precision: the label sweep streams a float copy of x_, everything else stays in double
+    bool mixed_ = false;
+    Matrix<float,Dynamic,Dynamic> xf_;
+    LogLikEngine<float> engineF_;
+
+    Membership indexLists_;          // index lists of the K_ components, rebuilt by updateIndexLists()
 
-    vector<vector<int>> indexLists_;
+    //per-component statistics kept in the label space of z_, updated by deltas during the sweep
+    typename dist_t::stats_t stats_;
+    StatsMode statsMode_ = StatsMode::incremental;
+    vector<int> compLabel_;          // label of every sampled component, singletons being skipped
+    vector<VectorXd> warmDir_;       // previous mean direction of every label, empty when unknown
+
+    //optional grouped layout: the rows of x_, and of every array indexed by row, sorted by label in
+    //updateIndexLists(); perm_ holds the observation of every row, and is empty when not grouped
+    bool grouped_ = false;
+    VectorXi perm_;
 
 
     //log in number of components, joint likelihood every iteration
     vector<VectorXi> logZ_;
     vector<int> logNum_;
     vector<double> logLogLik_; //https://stats.stackexchange.com/questions/398780/understanding-the-log-likelihood-score-in-scikit-learn-gmm
+    bool trackLogLik_ = false;
+
+
+
+    //restricted Gibbs scans of the split/merge proposals, and the number of scans each proposal took
+    LaunchOptions launch_;
+    vector<int> logScans_;
 
+    //two persistent sub-clusters per component, resampled along the main chain, from which splits are proposed
+    bool subClusters_ = false;
+    uint32_t subBurnIn_ = 5;         // sweeps before fresh sub-clusters may be proposed as a split
+    VectorXi zSub_;                  // sub-cluster, 0 or 1, of every observation within its component
+    typename dist_t::stats_t subStats_;    // positions only, sub-cluster l of label k at 2k+l
+    vector<typename dist_t::niw_t::component_t> subComponents_;   // two per sampled component
+    VectorXd subPi_;
+    vector<int> subAge_;             // sweeps since the sub-clusters of every label were initialized
 
 
     // incremental Learning
@@ -1,13 +1,34 @@
 #pragma once
 
-#include <boost/random/mersenne_twister.hpp>
 #include <Eigen/Dense>
+#include "philox.hpp"
 #include "gauss.hpp"
+#include "logLikEngine.hpp"
+#include "execution.hpp"
+#include "labelGroups.hpp"
+#include "suffStats.hpp"
+#include "kmeans.hpp"
 
 using namespace Eigen;
 using namespace std;
 
 
+struct LaunchOptions
+{
+    /**
+     * Stopping rule of the restricted Gibbs scans that lead a split/merge proposal to its launch state
+     *
+     * @param tolerance stop once at most this fraction of the observations changed sub-cluster in the last scan
+     * @param minScans, maxScans bounds on the number of scans; tolerance = 0 runs maxScans unless nothing moves
+     * @param kmeans the two-means clustering the scans start from
+     */
+    double tolerance  = 0.01;
+    uint32_t minScans = 10;
+    uint32_t maxScans = 50;
+    KmeansOptions kmeans;
+};
+
+
 template <class dist_t>
 class Dpmm 
 {
@@ -15,8 +36,9 @@ class Dpmm
     /*---------------------------------------------------*/
     //-------------Constructor & Desctructor--------------
     /*---------------------------------------------------*/
-    Dpmm(const MatrixXd& x, int init_cluster, double alpha, const dist_t& H, const boost::mt19937& rndGen, int base);
-    Dpmm(const MatrixXd& x, const VectorXi& z, const vector<int>& indexList, const double alpha, const dist_t& H, boost::mt19937& rndGen);
+    Dpmm(const MatrixXd& x, int init_cluster, double alpha, const dist_t& H, uint64_t seed, int base);
+    Dpmm(const MatrixXd& x, IndexView indexList, const double alpha, const dist_t& H, uint64_t seed,
+      const ExecutionContext &exec, const LaunchOptions &launch);
     Dpmm(){};
     ~Dpmm(){};
 
@@ -31,10 +53,12 @@ class Dpmm
     /*---------------------------------------------------*/
     //----------------Split/Merge Proposal----------------
     /*---------------------------------------------------*/
-    void sampleCoefficientsParameters(const vector<int> &indexList);
-    void sampleLabels(const vector<int> &indexList);
-    double logProposalRatio(const vector<int> & indexList_i,const vector<int> & indexList_j);
-    double logTargetRatio(const vector<int> &indexList_i, const vector<int> &indexList_j);
+    void sampleCoefficientsParameters_restricted();
+    uint32_t sampleLabels_restricted();
+    uint32_t launch(const LaunchOptions &opt);
+    double logProposalRatio(IndexView indexList_i, IndexView indexList_j);
+    double logTargetRatio(IndexView indexList_i, IndexView indexList_j);
+    vector<int> globalIndices(IndexView indexList) const;
 
 
     /*---------------------------------------------------*/
@@ -42,9 +66,14 @@ class Dpmm
     /*---------------------------------------------------*/    
     void reorderAssignments();
     void updateIndexLists();
-    vector<vector<int>> getIndexLists();
+    const Membership & getIndexLists();
     int getK(){return K_;};
     const VectorXi & getLabels(){return z_;};
+    void setExecution(const ExecutionContext &exec){exec_ = exec;};
+    void setGrouping(bool grouped);
+    void setStatsMode(StatsMode mode, uint32_t refresh = 0){statsMode_ = mode; stats_.setRefresh(refresh);};
+    void setLogLikTracking(bool track){trackLogLik_ = track;};
+    const vector<double> & getLogLogLik(){return logLogLik_;};
     
 
   private:
@@ -52,29 +81,41 @@ class Dpmm
     uint32_t dim_;
     double alpha_; 
     dist_t H_; 
-    boost::mt19937 rndGen_;
+    uint64_t seed_;
+    uint32_t stream_ = 0;   // Philox stream tag, advanced once per random phase
+    ExecutionContext exec_;
 
     //class initializer(dependent on data)
     MatrixXd x_;
     VectorXi z_;  
     VectorXd Pi_; 
-    uint16_t N_;
-    uint16_t K_;
+    uint32_t N_;
+    uint32_t K_;
 
     //sampled parameters
     vector<dist_t> parameters_; 
-    vector<Gauss<double>> components_; 
+    vector<typename dist_t::component_t> components_; 
+    LogLikEngine<double> engine_;
+
+    //per-component statistics of the full sampler, updated by deltas during the sweep; the restricted sampler of a
+    //split/merge proposal only keeps those of its two sub-clusters when grouped, see setGrouping()
+    typename dist_t::stats_t stats_;
+    StatsMode statsMode_ = StatsMode::incremental;
 
-    //spilt/merge proposal
+    //spilt/merge proposal: x_ and z_ only hold the local rows, i.e. the observations indexList_ of the caller
     vector<int> indexList_;
+    vector<uint32_t> threadCounts_;  // restricted sampler: offsets of every thread in the first sub-cluster
+    bool grouped_ = false;           // restricted sampler: posteriors from stats_, and groups_ for the target ratio
+    LabelGroups<double> groups_;
 
     //log in number of components, joint likelihood every iteration
     vector<VectorXi> logZ_;
     vector<int> logNum_;
     vector<double> logLogLik_; //https://stats.stackexchange.com/questions/398780/understanding-the-log-likelihood-score-in-scikit-learn-gmm
+    bool trackLogLik_ = false;
 
 public:
-    vector<vector<int>> indexLists_;
+    Membership indexLists_;          // index lists of the K_ components, or local rows of the two sub-clusters when restricted
 };
 
 
@@ -0,0 +1,57 @@
+/*
+* Execution context shared by all the parallel stages of the samplers
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <omp.h>
+
+
+struct ExecutionContext
+{
+    /**
+     * @param threads the size of the OpenMP team used by every parallel region; 0 picks omp_get_max_threads(), which
+     * honours OMP_NUM_THREADS
+     *
+     * @note nested samplers, e.g. the restricted Gibbs sampler of a split proposal, receive the context of their caller
+     * so that the whole run stays within the requested number of threads
+     */
+    int threads;
+
+    ExecutionContext(int numThreads = 0)
+    : threads(numThreads > 0 ? numThreads : omp_get_max_threads()) {};
+
+
+    int threadsFor(uint64_t work, uint64_t grain = 1) const
+    {
+      /**
+       * @return the team size for a loop of work items, such that every thread gets at least grain items
+       */
+      return int(std::max<uint64_t>(1, std::min<uint64_t>(threads, work / grain)));
+    };
+
+
+    ExecutionContext share(int teams) const
+    {
+      /**
+       * @return the context of one of teams concurrent tasks, each nested region getting its share of the threads
+       */
+      return ExecutionContext(std::max(1, threads / std::max(1, teams)));
+    };
+
+
+    uint32_t chunkRows(uint64_t N, uint32_t maxRows, uint32_t minRows = 32) const
+    {
+      /**
+       * @return the rows per dynamically scheduled chunk of an N-row sweep
+       *
+       * @param maxRows the largest chunk whose working set stays in cache, see LogLikEngine::blockRows()
+       *
+       * @note chunks shrink when N is small so that every thread still gets about four of them for load balancing
+       */
+      uint64_t balanced = (N + 4*uint64_t(threads) - 1) / (4*uint64_t(threads));
+      return uint32_t(std::max<uint64_t>(minRows, std::min<uint64_t>(maxRows, balanced)));
+    };
+};
@@ -1,29 +1,37 @@
 #pragma once
 
 #include <Eigen/Dense>
-#include <boost/random/mersenne_twister.hpp>
 
 #define PI 3.141592653589793
 
 using namespace Eigen;
 
-template<typename T>
+template<typename T, int dim = Dynamic>
 class Gauss
 {
     public:
-        Gauss(const Matrix<T,Dynamic,1> &mu, const Matrix<T,Dynamic,Dynamic> &sigma, boost::mt19937 &rndGen);
+        Gauss(const Matrix<T,dim,1> &mu, const Matrix<T,dim,dim> &sigma);
+        Gauss(const Matrix<T,dim,1> &mu, const Matrix<T,dim,dim> &chol, const Matrix<T,dim,dim> &invChol);
         Gauss(){};
         ~Gauss(){};
 
 
-        T logProb(const Matrix<T,Dynamic,1> &x_i);
-        T prob(const Matrix<T,Dynamic,1> &x_i);
+        T logProb(const Matrix<T,dim,1> &x_i) const;
+        T prob(const Matrix<T,dim,1> &x_i) const;
 
-    private:
-        boost::mt19937 rndGen_;
+        // cached factorization, read by the batched LogLikEngine
+        uint32_t getDim() const {return dim_;};
+        const Matrix<T,dim,1> & mu() const {return mu_;};
+        const Matrix<T,dim,dim> & invChol() const {return invChol_;};
+        T logNorm() const {return logNorm_;};
 
+    private:
         // parameters
         uint32_t dim_;
-        Matrix<T,Dynamic,1> mu_;
-        Matrix<T,Dynamic,Dynamic> sigma_;
+        Matrix<T,dim,1> mu_;
+        Matrix<T,dim,dim> sigma_;
+
+        // factorization of sigma_ = L L^T, computed once in the constructor
+        Matrix<T,dim,dim> invChol_;             // L^{-1}, lower triangular
+        T logNorm_;                             // -0.5 * (dim_ * log(2PI) + log|sigma_|)
 };
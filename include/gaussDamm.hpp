@@ -1,33 +1,70 @@
 #pragma once
 
 #include <Eigen/Dense>
-#include <boost/random/mersenne_twister.hpp>
 
 #define PI 3.141592653589793
 
 using namespace Eigen;
 
-template<typename T>
+template<typename T, int dim = Dynamic>
 class gaussDamm
 {
     public:
-        gaussDamm(const Matrix<T,Dynamic,1> &meanPos, const Matrix<T,Dynamic, Dynamic> &covPos,
-        const Matrix<T,Dynamic,1>& meanDir, T covDir, boost::mt19937 &rndGen);   
+        // dimension of the packed (position, geodesic distance) space and of the full (position, direction) space
+        enum { dimHat = (dim == Dynamic) ? Dynamic : dim+1, dimFull = (dim == Dynamic) ? Dynamic : 2*dim };
+
+        gaussDamm(const Matrix<T,dim,1> &meanPos, const Matrix<T,dim, dim> &covPos,
+        const Matrix<T,dim,1>& meanDir, T covDir);
+        gaussDamm(const Matrix<T,dim,1> &meanPos, const Matrix<T,dim, dim> &cholPos, const Matrix<T,dim, dim> &invCholPos,
+        const Matrix<T,dim,1>& meanDir, T covDir);
         gaussDamm(){};
         ~gaussDamm(){};
-        T logProb(const Matrix<T,Dynamic,1> &x_i);
+        T logProb(const Matrix<T,dimFull,1> &x_i) const;
+
+        // cached factorization, read by the batched LogLikEngine
+        uint32_t getDim() const {return dim_;};
+        const Matrix<T,dimHat,1> & meanHat() const {return meanHat_;};
+        const Matrix<T,dim,1> & meanDir() const {return meanDir_;};
+        const Matrix<T,dimHat,dimHat> & invCholHat() const {return invCholHat_;};
+        T logNorm() const {return logNorm_;};
+
+        // copy of the cached factorization in another scalar type, e.g. float for the mixed-precision label sweep
+        template<typename U> gaussDamm<U,dim> cast() const;
 
 
     private:
-        boost::mt19937 rndGen_;
+        template<typename U, int d> friend class gaussDamm;
 
         // parameters
-        Matrix<T,Dynamic,1> meanPos_;
-        Matrix<T,Dynamic,1> meanDir_;
-        Matrix<T,Dynamic,Dynamic> covPos_;
+        Matrix<T,dim,1> meanPos_;
+        Matrix<T,dim,1> meanDir_;
+        Matrix<T,dim,dim> covPos_;
         T covDir_;
 
-        Matrix<T,Dynamic,1> meanHat_;
-        Matrix<T,Dynamic,Dynamic> covHat_;
+        // factorization of covHat = L L^T, computed once in the constructor
+        Matrix<T,dimHat,1> meanHat_;
+        Matrix<T,dimHat,dimHat> invCholHat_;    // L^{-1}, lower triangular
+        T logNorm_;                             // -0.5 * (dim_ * log(2PI) + log|covHat|)
         uint32_t dim_;
 };
+
+
+
+template<typename T, int dim>
+template<typename U>
+gaussDamm<U,dim> gaussDamm<T,dim>::cast() const
+{
+  /**
+   * @note the factorization is not recomputed in the target type, only the cached factors are rounded
+   */
+  gaussDamm<U,dim> other;
+  other.meanPos_    = meanPos_.template cast<U>();
+  other.meanDir_    = meanDir_.template cast<U>();
+  other.covPos_     = covPos_.template cast<U>();
+  other.covDir_     = U(covDir_);
+  other.meanHat_    = meanHat_.template cast<U>();
+  other.invCholHat_ = invCholHat_.template cast<U>();
+  other.logNorm_    = U(logNorm_);
+  other.dim_        = dim_;
+  return other;
+}
@@ -0,0 +1,135 @@
+/*
+* KD-tree over a small set of points, e.g. the component means
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <queue>
+#include <utility>
+#include <vector>
+#include <Eigen/Dense>
+
+
+using namespace Eigen;
+
+
+
+template<typename T, int dim = Dynamic>
+class KdTree
+{
+    /**
+     * A balanced KD-tree stored implicitly in one array: the range [begin, end) of order_ is split at its middle
+     * entry, whose point holds the median along the axis of largest spread of the range
+     *
+     * @param points_ the indexed points
+     * @param order_ permutation of the points, arranged as the tree
+     * @param axis_ splitting axis of the node at every position of order_
+     *
+     * @note building takes O(K log^2 K) and a query of m neighbours O(m log K) on average
+     */
+    public:
+        typedef Matrix<T,dim,1> point_t;
+        typedef std::pair<T, uint32_t> neighbour_t;   // squared distance, index of the point
+
+        KdTree(){};
+        ~KdTree(){};
+
+
+        void build(const std::vector<point_t> &points)
+        {
+          points_ = points;
+          order_.resize(points_.size());
+          axis_.resize(points_.size());
+          for (uint32_t ii=0; ii<order_.size(); ++ii)
+            order_[ii] = ii;
+          this ->buildRange(0, order_.size());
+        };
+
+
+        std::vector<neighbour_t> nearest(uint32_t i, uint32_t m) const
+        {
+          /**
+           * @return the m nearest points of point i, i itself excluded, sorted by increasing distance
+           */
+          std::priority_queue<neighbour_t> heap;
+          if (m > 0)
+            this ->searchRange(0, order_.size(), points_[i], i, m, heap);
+
+          std::vector<neighbour_t> neighbours(heap.size());
+          for (uint32_t ii=neighbours.size(); ii>0; --ii) {
+            neighbours[ii-1] = heap.top();
+            heap.pop();
+          }
+          return neighbours;
+        };
+
+
+        uint32_t size() const {return points_.size();};
+
+
+    private:
+        void buildRange(uint32_t begin, uint32_t end)
+        {
+          if (end - begin < 2)  {
+            if (begin < end) axis_[begin] = 0;
+            return;
+          }
+
+          point_t lower = points_[order_[begin]];
+          point_t upper = lower;
+          for (uint32_t ii=begin+1; ii<end; ++ii)  {
+            lower = lower.cwiseMin(points_[order_[ii]]);
+            upper = upper.cwiseMax(points_[order_[ii]]);
+          }
+          Index axis;
+          (upper - lower).maxCoeff(&axis);
+
+          uint32_t mid = begin + (end - begin) / 2;
+          std::nth_element(order_.begin() + begin, order_.begin() + mid, order_.begin() + end,
+            [&](uint32_t a, uint32_t b){return points_[a][axis] < points_[b][axis];});
+          axis_[mid] = axis;
+
+          this ->buildRange(begin, mid);
+          this ->buildRange(mid+1, end);
+        };
+
+
+        void searchRange(uint32_t begin, uint32_t end, const point_t &query, uint32_t self, uint32_t m,
+          std::priority_queue<neighbour_t> &heap) const
+        {
+          if (begin >= end)
+            return;
+
+          uint32_t mid = begin + (end - begin) / 2;
+          uint32_t ii  = order_[mid];
+          if (ii != self)  {
+            T dist = (points_[ii] - query).squaredNorm();
+            if (heap.size() < m)
+              heap.push({dist, ii});
+            else if (dist < heap.top().first)  {
+              heap.pop();
+              heap.push({dist, ii});
+            }
+          }
+
+          T diff = query[axis_[mid]] - points_[ii][axis_[mid]];
+          if (diff < 0)
+            this ->searchRange(begin, mid, query, self, m, heap);
+          else
+            this ->searchRange(mid+1, end, query, self, m, heap);
+
+          // the other side may only hold a closer point if the splitting plane is within the current radius
+          if (heap.size() < m || diff * diff < heap.top().first)  {
+            if (diff < 0)
+              this ->searchRange(mid+1, end, query, self, m, heap);
+            else
+              this ->searchRange(begin, mid, query, self, m, heap);
+          }
+        };
+
+
+        std::vector<point_t> points_;
+        std::vector<uint32_t> order_;
+        std::vector<Index> axis_;
+};
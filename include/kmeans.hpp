@@ -1,40 +1,130 @@
-#include <iostream>
+/*
+* Two-means clustering with k-means++ seeding, used to initialize split proposals
+*/
+
+#pragma once
+
+#include <limits>
+#include <vector>
 #include <Eigen/Dense>
-#include <Eigen/Eigenvalues>
-#include <opencv2/core.hpp>
-#include <opencv2/core/eigen.hpp>
-#include <opencv2/ml.hpp>
+#include <boost/random/uniform_01.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include "philox.hpp"
+#include "execution.hpp"
+
 
-using namespace std;
 using namespace Eigen;
-using namespace cv;
-using namespace cv::ml;
-
-// Kmeans function
-
-vector<int> kmeans(const MatrixXd& Data, int numClusters) {
-    int numPoints = Data.rows();
-    Mat kmeansInputMat(Data.rows(), Data.cols(), CV_32F);
-    eigen2cv(Data, kmeansInputMat);
-    kmeansInputMat.convertTo(kmeansInputMat, CV_32F);
-    // std::cout << kmeansInputMat.type() << std::endl;
-    
-    Mat labels;
-    // std::vector<Point3f> centers;
-
-    kmeans(kmeansInputMat, numClusters, labels,
-            TermCriteria(TermCriteria::EPS + TermCriteria::COUNT, 100, 1.0),
-            3, KMEANS_RANDOM_CENTERS
-         );
-
-    // std::cout << labels << std::endl;
-
-    vector<int> clusterAssignments(numPoints);
-    const int* data = labels.ptr<int>();
-    clusterAssignments.assign(data, data + labels.total());
-    for (int i = 0; i < numPoints; ++i) {
-        clusterAssignments[i] = labels.at<int>(i);
+
+
+
+struct KmeansOptions
+{
+    /**
+     * @param restarts number of independent seedings, the clustering of least inertia is kept
+     * @param maxIter bound on the Lloyd iterations of every restart, which otherwise stop once no label changes
+     */
+    uint32_t restarts = 3;
+    uint32_t maxIter  = 100;
+};
+
+
+
+typedef Ref<const MatrixXd, 0, OuterStride<>> kmeansRows_t;   // rows to cluster, a block of the data is not copied
+
+
+
+inline double twoMeansRestart(const kmeansRows_t &data, Philox4x32 &rndGen, uint32_t maxIter, VectorXd &labels)
+{
+  /**
+   * This function runs one k-means++ seeding followed by Lloyd iterations, for two clusters
+   *
+   * @param labels output, 0 or 1 for every row
+   * @return the inertia, i.e. the sum of the squared distances of the rows to their center
+   *
+   * @note with two centers c0 and c1, a row x is closer to c1 iff x.(c1-c0) > (|c1|^2-|c0|^2)/2; the assignment is
+   * hence one matrix-vector product, and the sum of cluster 1 another one with the 0/1 labels, that of cluster 0
+   * following from the total
+   * @note besides labels, the only buffers are one distance and one previous label per row
+   */
+  const Index N = data.rows();
+  labels.setZero(N);
+  if (N < 2)
+    return 0;
+
+  boost::random::uniform_int_distribution<Index> uni_(0, N-1);
+  boost::random::uniform_01<> uni01_;
+  RowVectorXd c0 = data.row(uni_(rndGen));
+
+  // k-means++: the second seed is drawn proportionally to the squared distance to the first one
+  VectorXd dist = (data.rowwise() - c0).rowwise().squaredNorm();
+  double target = uni01_(rndGen) * dist.sum();
+  if (target == 0)
+    return 0;
+  Index pick = N-1;
+  for (Index ii=0; ii<N; ++ii) {
+    target -= dist[ii];
+    if (target < 0) {
+      pick = ii;
+      break;
     }
+  }
+  RowVectorXd c1 = data.row(pick);
+
+  const RowVectorXd sumAll = data.colwise().sum();
+  VectorXd labelsOld(N);
+  for (uint32_t tt=0; tt<maxIter; ++tt) {
+    labelsOld.swap(labels);
+    dist.noalias() = data * (c1 - c0).transpose();
+    labels = (dist.array() > (c1.squaredNorm() - c0.squaredNorm()) / 2).cast<double>();
+
+    double count1 = labels.sum();
+    if (count1 == 0 || count1 == N)
+      break;
+    RowVectorXd sum1 = labels.transpose() * data;
+    c0 = (sumAll - sum1) / (N - count1);
+    c1 = sum1 / count1;
+    if (tt > 0 && labels == labelsOld)
+      break;
+  }
+
+  dist = (data.rowwise() - c0).rowwise().squaredNorm();
+  double inertia = (1 - labels.array()).matrix().dot(dist);
+  dist = (data.rowwise() - c1).rowwise().squaredNorm();
+  return inertia + labels.dot(dist);
+}
+
+
+
+template<typename Derived>
+std::vector<int> twoMeans(const MatrixBase<Derived> &data, uint64_t seed, uint32_t stream, const KmeansOptions &opt,
+  const ExecutionContext &exec)
+{
+  /**
+   * This function splits the rows of data into two clusters
+   *
+   * @param data any Eigen expression; a block of the observations is read in place, a gather, e.g. an indexed view, is
+   * evaluated once
+   * @param seed, stream the Philox key; restart r draws from the generator at index r
+   * @return the label, 0 or 1, of every row
+   *
+   * @note the restarts run in parallel and the first one of least inertia wins, hence the result is independent of
+   * the number of threads
+   */
+  const kmeansRows_t rows(data.derived());
+  const uint32_t restarts = std::max<uint32_t>(1, opt.restarts);
+  std::vector<VectorXd> labels(restarts);
+  std::vector<double> inertia(restarts);
+
+  #pragma omp parallel for num_threads(exec.threadsFor(restarts)) schedule(dynamic, 1)
+  for (uint32_t rr=0; rr<restarts; ++rr) {
+    Philox4x32 rndGen(seed, stream, rr);
+    inertia[rr] = twoMeansRestart(rows, rndGen, opt.maxIter, labels[rr]);
+  }
+
+  uint32_t best = 0;
+  for (uint32_t rr=1; rr<restarts; ++rr)
+    if (inertia[rr] < inertia[best])
+      best = rr;
 
-    return clusterAssignments;
+  return std::vector<int>(labels[best].data(), labels[best].data() + labels[best].size());
 }
@@ -0,0 +1,54 @@
+/*
+* Observations grouped by label into contiguous row blocks
+*/
+
+#pragma once
+
+#include <vector>
+#include <Eigen/Dense>
+#include "execution.hpp"
+#include "membership.hpp"
+
+
+using namespace Eigen;
+
+
+template<typename T>
+class LabelGroups
+{
+    /**
+     * A permuted copy of the data in which the rows of every component are contiguous, so that a component is
+     * handed to a posterior as a block view instead of a gathered copy
+     *
+     * @param data_ (N, d) rows sorted by label; within a label the rows keep their original order
+     * @param owned_ the original row of every sorted row and the offsets of the components, see Membership
+     * @param shared_ the membership of the caller when grouped by it, which is then read in place of owned_
+     *
+     * @note the buffers are reused from one build to the next, so a build without a change in N allocates nothing
+     * @note a shared membership must outlive the groups and must not be rebuilt without rebuilding them as well
+     */
+    public:
+        typedef typename Matrix<T,Dynamic,Dynamic>::ConstRowsBlockXpr block_t;
+
+        LabelGroups(){};
+        ~LabelGroups(){};
+
+        void build(const Matrix<T,Dynamic,Dynamic> &x, const VectorXi &z, uint32_t K, const ExecutionContext &exec);
+        void build(const Matrix<T,Dynamic,Dynamic> &x, const Membership &members, const ExecutionContext &exec);
+        void build(const Matrix<T,Dynamic,Dynamic> &x, const std::vector<IndexView> &indexLists);
+
+        block_t block(uint32_t k) const {return data_.middleRows(this ->offset(k), this ->count(k));};
+        const Matrix<T,Dynamic,Dynamic> & data() const {return data_;};
+        const Membership & members() const {return shared_ ? *shared_ : owned_;};
+        uint32_t offset(uint32_t k) const {return this ->members().offset(k);};
+        uint32_t count(uint32_t k) const {return this ->members().count(k);};
+        uint32_t size() const {return this ->members().size();};
+
+
+    private:
+        void gather(const Matrix<T,Dynamic,Dynamic> &x, const ExecutionContext &exec);
+
+        Matrix<T,Dynamic,Dynamic> data_;
+        Membership owned_;
+        const Membership *shared_ = nullptr;
+};
@@ -0,0 +1,83 @@
+/*
+* Batched evaluation of the N x K matrix log(Pi_k) + logProb_k(x_i) used by label sampling
+*/
+
+#pragma once
+
+#include <vector>
+#include <Eigen/Dense>
+#include "gauss.hpp"
+#include "gaussDamm.hpp"
+#include "execution.hpp"
+
+
+using namespace Eigen;
+
+
+template<typename T>
+class LogLikEngine
+{
+    public:
+        LogLikEngine(){};
+        ~LogLikEngine(){};
+
+        template<int dim> void pack(const std::vector<gaussDamm<T,dim>> &components, const VectorXd &Pi);
+        template<int dim> void pack(const std::vector<Gauss<T,dim>> &components, const VectorXd &Pi);
+
+        void compute(const Ref<const Matrix<T,Dynamic,Dynamic>> &x, Ref<Matrix<T,Dynamic,Dynamic>> logLik) const;
+        void computeAll(const Matrix<T,Dynamic,Dynamic> &x, Matrix<T,Dynamic,Dynamic> &logLik, const ExecutionContext &exec) const;
+
+        uint32_t blockRows() const {return blockRows_;};   // largest block whose working set stays in cache
+        uint32_t getK() const {return K_;};
+
+
+    private:
+        uint32_t K_ = 0;
+        uint32_t dimPos_ = 0;
+        uint32_t dimDir_ = 0;            // 0 when the components carry no directional part
+        uint32_t blockRows_ = 256;
+
+        // positional part: the Mahalanobis terms become one GEMM against the whitening factors of all K components
+        Matrix<T,Dynamic,Dynamic> whiten_;      // (dimPos_, K*dimPos_) stacked L_k^{-T}
+        Matrix<T,1,Dynamic> offset_;            // (1, K*dimPos_) stacked mu_k^T L_k^{-T}
+
+        // directional part: cosines of the geodesic distances become one GEMM against the mean directions
+        Matrix<T,Dynamic,Dynamic> meanDir_;     // (dimDir_, K) unit mean directions
+        Matrix<T,1,Dynamic> precDir_;           // (1, K) inverse directional variance
+
+        Matrix<T,1,Dynamic> logWeight_;         // (1, K) log(Pi_k) + log-normalizer of component k
+};
+
+
+
+template<typename Derived>
+inline uint32_t sampleLogProb(const MatrixBase<Derived> &logProb, double uniDraw, double *logSumExp = nullptr)
+{
+  /**
+   * This function draws a label from the unnormalized log-probabilities of one observation
+   *
+   * @param logSumExp if given, receives log of the sum of exp(logProb), i.e. the log mixture likelihood of the
+   * observation when logProb holds log(Pi_k) + logProb_k; it reuses the normalizer of the draw
+   *
+   * @note equivalent to normalizing exp(logProb - max), accumulating the cumulative distribution and walking it
+   * until it exceeds uniDraw, without allocating the normalized vector
+   */
+  const uint32_t K = logProb.size();
+  const double maxProb = logProb.maxCoeff();
+
+  double sum = 0;
+  for (uint32_t kk=0; kk<K; ++kk)
+    sum += std::exp(logProb(kk) - maxProb);
+  if (logSumExp)
+    *logSumExp = maxProb + std::log(sum);
+
+  double threshold = uniDraw * sum;
+  double cumSum = 0;
+  for (uint32_t kk=0; kk<K-1; ++kk) {
+    cumSum += std::exp(logProb(kk) - maxProb);
+    if (cumSum >= threshold)
+      return kk;
+  }
+  return K-1;
+}
+
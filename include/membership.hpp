@@ -0,0 +1,103 @@
+/*
+* Component membership stored flat, as the offsets and the concatenated indices of every component
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <Eigen/Dense>
+#include "execution.hpp"
+
+
+using namespace Eigen;
+
+
+
+class IndexView
+{
+    /**
+     * A read-only view of the observation indices of one component, e.g. a slice of a Membership; a vector<int>
+     * converts to it implicitly, and Eigen accepts it wherever it accepts an index list, e.g. x(view, all)
+     *
+     * @note the view does not own its indices, which stay valid until the Membership or vector behind is rebuilt
+     */
+    public:
+        IndexView(): data_(nullptr), size_(0) {};
+        IndexView(const int *data, uint32_t size): data_(data), size_(size) {};
+        IndexView(const std::vector<int> &indexList): data_(indexList.data()), size_(indexList.size()) {};
+
+        Index size() const {return size_;};
+        bool empty() const {return size_ == 0;};
+        int operator[](Index i) const {return data_[i];};
+        const int * data() const {return data_;};
+        const int * begin() const {return data_;};
+        const int * end() const {return data_ + size_;};
+        std::vector<int> copy() const {return std::vector<int>(data_, data_ + size_);};
+
+
+    private:
+        const int *data_;
+        uint32_t size_;
+};
+
+
+
+class Membership
+{
+    /**
+     * The index lists of K components in compressed sparse row layout
+     *
+     * @param indices_ the concatenation of the index lists
+     * @param offsets_ K+1 entries, component k occupies indices_[offsets_[k], offsets_[k+1])
+     *
+     * @note build(z, K, exec) yields every index list in ascending order, whereas build(indexLists) and reset() with
+     * slot() keep the order given by the caller
+     *
+     * @note the buffers are reused from one build to the next, so that rebuilding with the same N and K allocates
+     * nothing
+     */
+    public:
+        Membership(){};
+        ~Membership(){};
+
+        void build(const VectorXi &z, uint32_t K, const ExecutionContext &exec);
+        void build(const std::vector<IndexView> &indexLists);
+        void reset(const uint32_t *counts, uint32_t K);
+        void renumber();
+
+        IndexView operator[](uint32_t k) const {return IndexView(indices_.data() + offsets_[k], this ->count(k));};
+        int * slot(uint32_t k) {return indices_.data() + offsets_[k];};
+        const std::vector<int> & indices() const {return indices_;};
+        uint32_t offset(uint32_t k) const {return offsets_[k];};
+        uint32_t count(uint32_t k) const {return offsets_[k+1] - offsets_[k];};
+        uint32_t size() const {return offsets_.empty() ? 0 : offsets_.size() - 1;};
+
+
+    private:
+        std::vector<int> indices_;
+        std::vector<uint32_t> offsets_;
+        std::vector<uint32_t> hist_;
+};
+
+
+
+template<typename MatrixType>
+void permuteRows(MatrixType &x, const std::vector<int> &order, const ExecutionContext &exec)
+{
+  /**
+   * This function reorders the rows of x in place, such that row i becomes the former row order[i], e.g. with the
+   * indices of a Membership to sort the data by label
+   *
+   * @note the rows are moved one column at a time through a scratch column, hence the extra memory is one column
+   */
+  const uint32_t N = x.rows();
+  Matrix<typename MatrixType::Scalar,Dynamic,1> column(N);
+
+  for (Index cc=0; cc<x.cols(); ++cc) {
+    #pragma omp parallel for num_threads(exec.threadsFor(N, 4096)) schedule(static)
+    for (uint32_t ii=0; ii<N; ++ii)
+      column[ii] = x(order[ii], cc);
+    x.col(cc) = column;
+  }
+}
@@ -0,0 +1,88 @@
+/*
+* Schedule of the split/merge moves interleaved with the Gibbs sweeps
+*/
+
+#pragma once
+
+#include <cstdint>
+#include "damm.hpp"
+
+
+struct MoveRule
+{
+    /**
+     * When and how one kind of move is proposed
+     *
+     * @param every iterations between two rounds; 0 disables the move
+     * @param start, stop rounds take place at iterations in [start, stop); stop = 0 never ends
+     * @param minSize split: components of more than minSize observations; merge: pairs of more than minSize together
+     * @param maxProposals proposals per round; 0 proposes every candidate
+     */
+    uint32_t every;
+    uint32_t start;
+    uint32_t stop;
+    uint32_t minSize;
+    uint32_t maxProposals;
+};
+
+
+
+struct MoveOptions
+{
+    /**
+     * @param split, merge the rules of both moves; the defaults propose splits at t = 50, 100, 150, 200 and no merge
+     * @param mergeSimilarity how merge candidates are paired, see Damm::computeSimilarity
+     * @param mergeAccepted a merge round stops after this many accepted merges
+     * @param adaptive rescale the period of a move from its acceptance rate: halved above rateHigh, doubled below
+     * rateLow, within [1, maxEvery]
+     * @param rateWeight weight of the last round in the running acceptance rate
+     */
+    MoveRule split = {50, 50, 250, 5, 0};
+    MoveRule merge = {0, 30, 175, 0, 0};
+    int mergeSimilarity    = 2;
+    uint32_t mergeAccepted = 1;
+
+    bool adaptive     = false;
+    double rateLow    = 0.1;
+    double rateHigh   = 0.5;
+    double rateWeight = 0.5;
+    uint32_t maxEvery = 100;
+};
+
+
+
+class MoveScheduler
+{
+    /**
+     * Decides at every iteration whether a round of split or merge proposals takes place, runs it on the sampler and
+     * keeps track of the acceptance rates
+     *
+     * @note a round replaces nothing: the Gibbs sweep of the iteration follows as usual; at most one round, splits
+     * first, takes place per iteration
+     */
+    public:
+        MoveScheduler(const MoveOptions &opt);
+        MoveScheduler(){};
+        ~MoveScheduler(){};
+
+        template <class dist_t> bool run(int t, Damm<dist_t> &damm);
+
+        bool splitDue(int t) const {return this ->due(opt_.split, splitNext_, t);};
+        bool mergeDue(int t) const {return this ->due(opt_.merge, mergeNext_, t);};
+        double splitRate() const {return splitRate_;};
+        double mergeRate() const {return mergeRate_;};
+        uint32_t splitEvery() const {return opt_.split.every;};
+        uint32_t mergeEvery() const {return opt_.merge.every;};
+
+
+    private:
+        bool due(const MoveRule &rule, uint32_t next, int t) const;
+        void record(const char *move, MoveRule &rule, uint32_t &next, double &rate, int t, uint32_t numProposed,
+          int numAccepted);
+
+        MoveOptions opt_;
+        uint32_t splitNext_ = 0;     // earliest iteration of the next round
+        uint32_t mergeNext_ = 0;
+        double splitRate_ = -1;      // running acceptance rate, negative until the first round
+        double mergeRate_ = -1;
+};
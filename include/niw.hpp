@@ -5,45 +5,54 @@
 #pragma once
 
 #include <Eigen/Dense>
-#include <boost/random/mersenne_twister.hpp>
+#include "philox.hpp"
 #include "gauss.hpp"
+#include "suffStats.hpp"
 #include <memory>
 
 
 using namespace Eigen;
 
-template<typename T> //cyclic dependency
+template<typename T, int dim> //cyclic dependency
 class NiwDamm;
 
 
-template<typename T>
+template<typename T, int dim = Dynamic>
 class Niw
 {
     public:
-        Niw(const MatrixXd &sigma, const VectorXd &mu, T nu, T kappa, boost::mt19937 &rndGen, int base);
-        Niw(const MatrixXd &sigma, const VectorXd &mu, T nu, T kappa, boost::mt19937 &rndGen);
+        typedef Gauss<T,dim> component_t;
+        typedef StatsStore<T,dim> stats_t;
+        typedef Ref<const Matrix<T,Dynamic,Dynamic>, 0, OuterStride<>> rows_t;  // row block of the data, no copy
+
+        Niw(const MatrixXd &sigma, const VectorXd &mu, T nu, T kappa, int base);
+        Niw(const Matrix<T,dim,dim> &sigma, const Matrix<T,dim,1> &mu, T nu, T kappa);
         Niw(){};
         ~Niw(){};
 
-        void getSufficientStatistics(const Matrix<T,Dynamic, Dynamic> &x_k);
-        Niw<T> posterior(const Matrix<T,Dynamic, Dynamic> &x_k);
-        Gauss<T> samplePosteriorParameter(const Matrix<T,Dynamic, Dynamic> &x_k);
-        Gauss<T> sampleParameter();
+        void getSufficientStatistics(const rows_t &x_k);
+        void getSufficientStatistics(const SuffStats<T,dim> &stats, const Matrix<T,dim,1> &shift);
+        Niw<T,dim> posterior(const rows_t &x_k);
+        Niw<T,dim> posterior(const SuffStats<T,dim> &stats, const Matrix<T,dim,1> &shift);
+        T logMarginal(const SuffStats<T,dim> &stats, const Matrix<T,dim,1> &shift);
+        Gauss<T,dim> samplePosteriorParameter(const Matrix<T,Dynamic, Dynamic> &x_k, Philox4x32 &rndGen);
+        Gauss<T,dim> sampleParameter(Philox4x32 &rndGen) const;
 
  
     private:
-        boost::mt19937 rndGen_;
+        Niw<T,dim> posterior() const;
+
         uint32_t dim_;  // 2 or 3 for base 1; 4 or 6 for base 2
 
         // hyperparameter
-        Matrix<T,Dynamic,Dynamic> sigma_;
-        Matrix<T,Dynamic,1> mu_;
+        Matrix<T,dim,dim> sigma_;
+        Matrix<T,dim,1> mu_;
         T nu_,kappa_;
 
         // sufficient statistics
-        Matrix<T,Dynamic,Dynamic> scatter_;
-        Matrix<T,Dynamic,1> mean_;
-        uint16_t count_;
+        Matrix<T,dim,dim> scatter_;
+        Matrix<T,dim,1> mean_;
+        int64_t count_;
 };
 
 
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <Eigen/Dense>
-#include <boost/random/mersenne_twister.hpp>
+#include "philox.hpp"
 #include "gaussDamm.hpp"
 #include "niw.hpp"
+#include "suffStats.hpp"
+#include "riem.hpp"
 #include <memory>
 
 
@@ -11,44 +13,58 @@
 using namespace Eigen;
 
 
-template<typename T>
+template<typename T, int dim = Dynamic>
 class NiwDamm
 {
     public:
-        NiwDamm(const Matrix<T,Dynamic,Dynamic>& sigma, const Matrix<T,Dynamic,Dynamic>& mu, T nu, T kappa, T sigmaDir,
-        boost::mt19937 &rndGen);
-        NiwDamm(const Matrix<T,Dynamic,Dynamic>& sigmaPos, const Matrix<T,Dynamic,1>& muPos, T nu, T kappa, T sigmaDir, 
-        const Matrix<T,Dynamic,1>& muDir, T count, boost::mt19937 &rndGen);        
+        typedef gaussDamm<T,dim> component_t;
+        typedef gaussDamm<float,dim> componentf_t;  // single-precision copy used by the mixed-precision label sweep
+        typedef Niw<T,dim> niw_t;
+        typedef StatsStore<T,dim> stats_t;
+        typedef Ref<const Matrix<T,Dynamic,Dynamic>, 0, OuterStride<>> rows_t;     // row block of the data, no copy
+        typedef Ref<const Matrix<T,Dynamic,dim>, 0, OuterStride<>> dirRows_t;      // its directional columns
+        typedef Matrix<T,dim,1> dir_t;
+
+        NiwDamm(const Matrix<T,Dynamic,Dynamic>& sigma, const Matrix<T,Dynamic,Dynamic>& mu, T nu, T kappa, T sigmaDir);
+        NiwDamm(const Matrix<T,dim,dim>& sigmaPos, const Matrix<T,dim,1>& muPos, T nu, T kappa, T sigmaDir, 
+        const Matrix<T,dim,1>& muDir, T count);
         NiwDamm(){};
         ~NiwDamm(){};
 
 
-        void getSufficientStatistics(const Matrix<T,Dynamic, Dynamic>& x_k);
-        NiwDamm<T> posterior(const Matrix<T,Dynamic, Dynamic>& x_k);
-        gaussDamm<T> samplePosteriorParameter(const Matrix<T,Dynamic, Dynamic> &x_k);
-        gaussDamm<T> sampleParameter();
+        void getSufficientStatistics(const rows_t &x_k);
+        void getSufficientStatistics(const SuffStats<T,dim> &stats, const Matrix<T,dim,1> &shift, const dirRows_t &xDir_k, 
+        const dir_t *warmDir = nullptr);
+        NiwDamm<T,dim> posterior(const rows_t &x_k);
+        NiwDamm<T,dim> posterior(const SuffStats<T,dim> &stats, const Matrix<T,dim,1> &shift, const dirRows_t &xDir_k, 
+        const dir_t *warmDir = nullptr);
+        gaussDamm<T,dim> samplePosteriorParameter(const Matrix<T,Dynamic, Dynamic> &x_k, Philox4x32 &rndGen);
+        gaussDamm<T,dim> sampleParameter(Philox4x32 &rndGen) const;
+        void setKarcher(const KarcherOptions &opt){karcher_ = opt;};
+        const dir_t & getMuDir() const {return muDir_;};
     
     public:
-        std::shared_ptr<Niw<T>> NIW_ptr;
+        std::shared_ptr<Niw<T,dim>> NIW_ptr;
 
     private:
-        boost::mt19937 rndGen_;
+        NiwDamm<T,dim> posterior() const;
 
         // Hyperparameters
-        Matrix<T,Dynamic,Dynamic> sigmaPos_;
-        Matrix<T,Dynamic,1> muPos_;
+        Matrix<T,dim,dim> sigmaPos_;
+        Matrix<T,dim,1> muPos_;
         T nu_,kappa_;
-        Matrix<T,Dynamic,1> muDir_;
+        Matrix<T,dim,1> muDir_;
         T sigmaDir_;
         uint32_t dim_;
+        KarcherOptions karcher_;
 
 
         // Sufficient statistics
-        Matrix<T,Dynamic,Dynamic> scatterPos_;
+        Matrix<T,dim,dim> scatterPos_;
         T scatterDir_;
-        Matrix<T,Dynamic,1> meanPos_;
-        Matrix<T,Dynamic,1> meanDir_;
-        uint16_t count_;
+        Matrix<T,dim,1> meanPos_;
+        Matrix<T,dim,1> meanDir_;
+        int64_t count_;
 };
 
 
@@ -0,0 +1,70 @@
+/*
+* Counter-based Philox4x32-10 random number generator (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3")
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <array>
+
+
+class Philox4x32
+{
+    /**
+     * Every draw is a pure function of (seed, stream, index, position), so a generator can be constructed on the spot
+     * for every observation or component inside a parallel loop; the result neither depends on the thread count nor
+     * on the schedule, and no state is shared between threads
+     *
+     * @param seed the 64-bit key, i.e. the --seed of the run
+     * @param stream a 32-bit tag distinguishing the sampling phases, e.g. one per sweep of a sampler
+     * @param index a 64-bit tag within the phase, e.g. the observation or component index
+     *
+     * @note satisfies the uniform random bit generator requirements, hence usable by the boost distributions
+     */
+    public:
+        typedef uint32_t result_type;
+
+        Philox4x32(uint64_t seed, uint32_t stream, uint64_t index)
+        : key_{uint32_t(seed), uint32_t(seed >> 32)}, ctr_{0, uint32_t(index), uint32_t(index >> 32), stream}, pos_(4) {};
+
+        static constexpr result_type min() {return 0;};
+        static constexpr result_type max() {return 0xFFFFFFFFu;};
+
+        result_type operator()()
+        {
+          if (pos_ == 4) {
+            generate();
+            ++ctr_[0];
+            pos_ = 0;
+          }
+          return out_[pos_++];
+        };
+
+        // 64-bit key for a nested sampler, e.g. the restricted Gibbs sampler of a split proposal
+        uint64_t spawnSeed()
+        {
+          uint64_t lo = (*this)();
+          return (uint64_t((*this)()) << 32) | lo;
+        };
+
+
+    private:
+        void generate()
+        {
+          std::array<uint32_t,4> c = ctr_;
+          std::array<uint32_t,2> k = key_;
+          for (int r=0; r<10; ++r) {
+            uint64_t p0 = uint64_t(0xD2511F53u) * c[0];
+            uint64_t p1 = uint64_t(0xCD9E8D57u) * c[2];
+            c = {uint32_t(p1 >> 32) ^ c[1] ^ k[0], uint32_t(p1), uint32_t(p0 >> 32) ^ c[3] ^ k[1], uint32_t(p0)};
+            k[0] += 0x9E3779B9u;
+            k[1] += 0xBB67AE85u;
+          }
+          out_ = c;
+        };
+
+        std::array<uint32_t,2> key_;
+        std::array<uint32_t,4> ctr_;     // (block, index low, index high, stream)
+        std::array<uint32_t,4> out_;
+        uint32_t pos_;
+};
@@ -0,0 +1,88 @@
+/*
+* Compaction of the labels after components vanish
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <Eigen/Dense>
+#include "execution.hpp"
+
+
+using namespace Eigen;
+
+
+
+inline std::vector<int> compactLabels(VectorXi &z, const ExecutionContext &exec)
+{
+  /**
+   * This function renumbers the labels of z to [0, K), K being the number of distinct labels, in the order of their
+   * first occurrence in z
+   *
+   * @param z non-negative labels, rewritten in place
+   * @return the former label of every new label, e.g. to select the statistics of the surviving components
+   *
+   * @note every thread owns one static range of z; in a first pass it records the first occurrence of every label in
+   * its range, then, after a serial reduction of these tables into a dense remap table, it rewrites its range; the
+   * cost is O(N + T L) for T threads and labels below L, and the result is the same for any number of threads
+   */
+  const uint32_t N = z.size();
+  const int maxThreads = exec.threadsFor(N, 4096);
+
+  std::vector<int> maxLabel(maxThreads, -1);
+  std::vector<uint32_t> first;
+  std::vector<int> remap;
+  std::vector<int> former;
+
+  #pragma omp parallel num_threads(maxThreads)
+  {
+    const int numThreads = omp_get_num_threads();
+    const int tid        = omp_get_thread_num();
+    const uint32_t chunk = (N + numThreads - 1) / numThreads;
+    const uint32_t begin = std::min<uint64_t>(N, uint64_t(tid) * chunk);
+    const uint32_t end   = std::min<uint64_t>(N, uint64_t(begin) + chunk);
+
+    for (uint32_t ii=begin; ii<end; ++ii)
+      maxLabel[tid] = std::max(maxLabel[tid], z[ii]);
+
+    #pragma omp barrier
+    #pragma omp single
+    {
+      const int L = *std::max_element(maxLabel.begin(), maxLabel.begin() + numThreads) + 1;
+      first.assign(uint64_t(numThreads) * L, N);
+      remap.assign(L, -1);
+    }
+
+    const uint64_t L = remap.size();
+    uint32_t *firstLocal = first.data() + uint64_t(tid) * L;
+    for (uint32_t ii=end; ii>begin; --ii)
+      firstLocal[z[ii-1]] = ii-1;
+
+    #pragma omp barrier
+    #pragma omp single
+    {
+      std::vector<std::pair<uint32_t, int>> order;
+      for (uint64_t ll=0; ll<L; ++ll) {
+        uint32_t firstAll = N;
+        for (int tt=0; tt<numThreads; ++tt)
+          firstAll = std::min(firstAll, first[uint64_t(tt) * L + ll]);
+        if (firstAll < N)
+          order.push_back({firstAll, int(ll)});
+      }
+      std::sort(order.begin(), order.end());
+
+      former.resize(order.size());
+      for (uint32_t kk=0; kk<order.size(); ++kk) {
+        former[kk] = order[kk].second;
+        remap[order[kk].second] = kk;
+      }
+    }
+
+    for (uint32_t ii=begin; ii<end; ++ii)
+      z[ii] = remap[z[ii]];
+  }
+
+  return former;
+}
@@ -1,106 +1,200 @@
+#pragma once
+
 #include <iostream>
+#include <cmath>
 #include <Eigen/Dense>
 
 using namespace Eigen;
 using namespace std;
 
+
+
+/*---------------------------------------------------*/
+//------------------Batch Kernels--------------------
+/*---------------------------------------------------*/
+
 template <typename T>
-double unsigned_angle(const Matrix<T,Dynamic, 1>&x, const Matrix<T,Dynamic, 1>&y)
+void rie_acos(T *c, Index n)
+{
+  /**
+   * This function overwrites n cosines with their arccos, i.e. the geodesic distances on the unit sphere
+   *
+   * @param c contiguous array of cosines, clamped to [-1, 1] before use
+   *
+   * @note uses the half-angle identity acos(c) = 2 asin(s) = PI - 2 acos(s) with s = sqrt((1-c)/2) in [0, 1], so
+   * that the polynomial of Abramowitz & Stegun 4.4.46, acos(s) = sqrt(1-s) * P(s) on [0, 1], covers the full range
+   * without any sign branch
+   *
+   * @note 1-s is taken as (1-s^2)/(1+s) = ((1+c)/2)/(1+s), as 1-s cancels near c = -1; and PI is replaced by 2 P(0),
+   * so that the angle between near-coincident directions carries no constant bias
+   *
+   * @note in double precision acos(1) = 0 exactly, the absolute error is < 1e-7 rad over [-1, 1] and the relative
+   * error < 5e-6 for small angles; in single precision the absolute error stays below 1e-6 rad
+   *
+   * @note every step is a coefficient-wise Eigen array expression (min/max, sqrt, fused multiply-add), hence
+   * vectorized through Eigen's packet math on SSE/AVX2/NEON; as both c and s enter the polynomial, s is kept per
+   * chunk in a fixed-size stack buffer, hence nothing is allocated
+   */
+  const Index chunk = 256;
+  Array<T,chunk,1> sBuf;
+
+  for (Index begin=0; begin<n; begin+=chunk) {
+    Index rows = std::min(chunk, n - begin);
+    Map<Array<T,Dynamic,1>> a(c + begin, rows);
+    Map<Array<T,Dynamic,1>> s(sBuf.data(), rows);
+
+    a = a.cwiseMax(T(-1)).cwiseMin(T(1));
+    s = ((T(1) - a) * T(0.5)).sqrt();
+    a = T(2) * T(1.5707963050) - T(2) * ((T(1) + a) * T(0.5) / (T(1) + s)).sqrt() *
+        (T(1.5707963050) + s*(T(-0.2145988016) + s*(T(0.0889789874) + s*(T(-0.0501743046) +
+        s*(T(0.0308918810) + s*(T(-0.0170881256) + s*(T(0.0066700901) + s*T(-0.0012624911))))))));
+  }
+}
+
+
+
+template <typename T, typename DerivedX, typename DerivedY>
+void rie_angle(const MatrixBase<DerivedX> &x, const MatrixBase<DerivedY> &y, Matrix<T,Dynamic,Dynamic> &angle)
+{
+  /**
+   * This function computes the geodesic distances between many points of tangency and a block of directions
+   *
+   * @param x (K, d) points of tangency, one per row
+   * @param y (n, d) unit directions, one per row
+   * @param angle (n, K) output, resized only if its shape differs
+   *
+   * @note the cosines come out of one GEMM, followed by the in-place batch arccos
+   */
+  angle.resize(y.rows(), x.rows());
+  angle.noalias() = y * x.transpose();
+  rie_acos(angle.data(), angle.size());
+}
+
+
+
+template <typename T, int dim, typename Derived>
+void rie_log_sum(const Matrix<T,dim, 1>&x, const MatrixBase<Derived> &y, Matrix<T,dim, 1> &sumDir, T &sumSq)
+{
+  /**
+   * This function accumulates the logarithmic map of a block of directions w.r.t. a single point of tangency
+   *
+   * @param x the point of tangency
+   * @param y (n, d) unit directions, one per row
+   * @param sumDir the sum of log_x(y_i) over all rows
+   * @param sumSq the sum of |log_x(y_i)|^2, i.e. the squared geodesic distances
+   *
+   * @note log_x(y_i) = theta_i / sin(theta_i) * (y_i - cos(theta_i) x), so the sum reduces to y^T w - (w.c) x with
+   * w_i = theta_i / sin(theta_i); the (n, d) tangent vectors are never formed
+   *
+   * @note rows are processed in chunks through fixed-size stack buffers, hence no heap allocation
+   */
+  const Index chunk = 256;
+  Matrix<T,chunk,1> cosBuf, angleBuf;
+
+  sumDir.setZero(x.size());
+  sumSq = 0;
+
+  for (Index begin=0; begin<y.rows(); begin+=chunk) {
+    Index rows = std::min(chunk, y.rows() - begin);
+    Map<Matrix<T,Dynamic,1>> c(cosBuf.data(), rows);
+    Map<Matrix<T,Dynamic,1>> w(angleBuf.data(), rows);
+
+    c.noalias() = y.middleRows(begin, rows) * x;
+    c = c.cwiseMax(T(-1)).cwiseMin(T(1));
+    w = c;
+    rie_acos(w.data(), rows);
+    sumSq += w.squaredNorm();
+
+    w.array() /= (T(1) - c.array().square()).cwiseMax(T(1e-24)).sqrt();
+    sumDir.noalias() += y.middleRows(begin, rows).transpose() * w;
+    sumDir -= w.dot(c) * x;
+  }
+}
+
+
+
+/*---------------------------------------------------*/
+//-------------------Single Vector-------------------
+/*---------------------------------------------------*/
+
+template <typename T, int dim>
+T unsigned_angle(const Matrix<T,dim, 1>&x, const Matrix<T,dim, 1>&y)
 {
   /**
    * This function computes the (unsigned) angle between two points in unit sphere
    *
-   * @param x point x 
+   * @param x point x
    * @param y point y
-   * 
+   *
+   * @note a zero-length input has no direction; the angle is then reported as zero instead of NaN
    */
-  
-  double dotProduct = x.dot(y);
-  double cosAngle = dotProduct / (x.norm() * y.norm());
-  double angle = std::acos(std::min(std::max(cosAngle, -1.0), 1.0));
 
-  if (std::isnan(angle)) {
-      throw std::runtime_error("NaN angle value");
-  }
+  T norm = x.norm() * y.norm();
+  if (norm == 0)
+    return 0;
 
-  return angle; 
+  T cosAngle = x.dot(y) / norm;
+  return std::acos(std::min(std::max(cosAngle, T(-1)), T(1)));
 }
 
 
-template <typename T>
-Eigen::VectorXd unsigned_angle(const Matrix<T,Dynamic, 1>&x, const Matrix<T,Dynamic, Dynamic>&y)
+template <typename T, int dim>
+Matrix<T,Dynamic, 1> unsigned_angle(const Matrix<T,dim, 1>&x, const Matrix<T,Dynamic, dim>&y)
 {
-  int numRows = y.rows();
-  Eigen::VectorXd dotProduct = (x.transpose().replicate(numRows, 1).array() * y.array()).rowwise().sum();
-  Eigen::VectorXd angles = dotProduct.cwiseMax(-1.0).cwiseMin(1.0).unaryExpr([](double val) { return std::acos(val); });
-
-  // Eigen::MatrixXd x_rep = x.transpose().replicate(numRows, 1);
-  // Eigen::VectorXd dotProduct = (x_rep.array() * y.array()).rowwise().sum();
-  // dotProduct = dotProduct.cwiseMax(-1.0).cwiseMin(1.0);
-  // Eigen::VectorXd angles = dotProduct.unaryExpr([](double val) { return std::acos(val); });
+  Matrix<T,Dynamic, Dynamic> angles;
+  rie_angle(x.transpose(), y, angles);
   return angles;
 }
 
 
-template <typename T>
-Matrix<T,Dynamic, Dynamic> rie_log(const Matrix<T,Dynamic, 1>&x, const Matrix<T,Dynamic, Dynamic>&y)
-{   
-  // vectorized
-
-  int numRows = y.rows();
-  int numCols = y.cols();
-  
-  Eigen::VectorXd u_sca = unsigned_angle(x, y).unaryExpr([](double val) { return val== M_PI ? M_PI -0.0001: val; });
-  Eigen::MatrixXd x_rep = x.transpose().replicate(numRows, 1);
-  Eigen::MatrixXd y_x_T_y_x = y.array() - (x_rep.array() * y.array()).rowwise().sum().replicate(1, numCols).array() * x_rep.array();
-  y_x_T_y_x = y_x_T_y_x.array() / y_x_T_y_x.rowwise().norm().replicate(1, numCols).array();
-  Eigen::MatrixXd u = u_sca.replicate(1, numCols).array() * y_x_T_y_x.unaryExpr([](double val) { return std::isnan(val) ? 0.0 : val; }).array();
-
-
-  // Eigen::VectorXd u_sca = unsigned_angle(x, y);
-  // u_sca = u_sca.unaryExpr([](double val) { return val== M_PI ? M_PI -0.0001: val; });
-  // Eigen::MatrixXd x_rep = x.transpose().replicate(numRows, 1);
-  // Eigen::VectorXd x_T_y = (x_rep.array() * y.array()).rowwise().sum();
-  // Eigen::MatrixXd y_x_T_y_x = y.array() - x_T_y.replicate(1, numCols).array() * x_rep.array();
-  // y_x_T_y_x = y_x_T_y_x.array() / y_x_T_y_x.rowwise().norm().replicate(1, numCols).array();
-  // y_x_T_y_x = y_x_T_y_x.unaryExpr([](double val) { return std::isnan(val) ? 0.0 : val; });
-  // Eigen::MatrixXd u = u_sca.replicate(1, numCols).array() * y_x_T_y_x.array();
-  
+template <typename T, int dim>
+Matrix<T,Dynamic, dim> rie_log(const Matrix<T,dim, 1>&x, const Matrix<T,Dynamic, dim>&y)
+{
+  /**
+   * This function maps every row of y to the tangent space defined by x; i.e. log_x(y_i) = w_i (y_i - c_i x)
+   *
+   * @note only the returned matrix is allocated, see rie_log_sum when only the sum is needed
+   */
+
+  Matrix<T,Dynamic, 1> c = y * x;
+  c = c.cwiseMax(T(-1)).cwiseMin(T(1));
+  Matrix<T,Dynamic, 1> w = c;
+  rie_acos(w.data(), w.size());
+  w.array() /= (T(1) - c.array().square()).cwiseMax(T(1e-24)).sqrt();
+
+  Matrix<T,Dynamic, dim> u = y;
+  u.noalias() -= c * x.transpose();
+  u = u.array().colwise() * w.array();
+
   return u;
 }
 
 
-template <typename T>
-Matrix<T,Dynamic, 1> rie_log(const Matrix<T,Dynamic, 1>&x, const Matrix<T,Dynamic, 1>&y)
-{   
+template <typename T, int dim>
+Matrix<T,dim, 1> rie_log(const Matrix<T,dim, 1>&x, const Matrix<T,dim, 1>&y)
+{
   /**
    * This function maps a point y to the tangent space defined by x
    *
-   * @param x is the point of tangency 
+   * @param x is the point of tangency
    * @param y point y
-   * @param tanDir non-unit length tangent direction at point x 
+   * @param tanDir non-unit length tangent direction at point x
    * @param v is the point y mapped to tangent space defined by x as the point of tangency; i.e. log_x(y)
-   * 
+   *
    * @note v gives the corrdinates starting at point x
    * @note when x and y are in opposite direction (rarely happens), log map returns zero; hence we manually add perturbation
    * @note when x and y are equal (tanDir.norm()=0), return tanDir = (0, 0, 0)
    */
 
-  double angle;
-  try {
-      angle = unsigned_angle(x, y);
-  } catch (const std::exception& e) {
-      std::cerr << "Error: " << e.what() << std::endl;
-      exit(0);
-  }
-  
-  VectorXd tanDir = y - x.dot(y) * x;
+  T angle = unsigned_angle(x, y);
+
+  Matrix<T,dim, 1> tanDir = y - x.dot(y) * x;
   if (tanDir.norm() == 0)
     return tanDir;
 
-  if (angle == M_PI)
-    angle = M_PI-0.0001;
-  VectorXd v = angle * tanDir / tanDir.norm();
+  if (angle == T(M_PI))
+    angle = T(M_PI-0.0001);
+  Matrix<T,dim, 1> v = angle * tanDir / tanDir.norm();
 
   return v;
 }
@@ -108,8 +202,8 @@ Matrix<T,Dynamic, 1> rie_log(const Matrix<T,Dynamic, 1>&x, const Matrix<T,Dynami
 
 
 
-template <typename T>
-Matrix<T,Dynamic, 1> rie_exp(const Matrix<T,Dynamic, 1>&x, const Matrix<T,Dynamic, 1>&v)
+template <typename T, int dim>
+Matrix<T,dim, 1> rie_exp(const Matrix<T,dim, 1>&x, const Matrix<T,dim, 1>&v)
 {
   /**
    * This function maps a point y to the tangent space defined by x
@@ -117,57 +211,96 @@ Matrix<T,Dynamic, 1> rie_exp(const Matrix<T,Dynamic, 1>&x, const Matrix<T,Dynami
    * @param x is the point of tangency
    * @param v is the point y mapped to tangent space defined by x as the point of tangency; i.e. log_x(y)
    * @param y is the point of v mapped back to unit sphere
-   * 
+   *
    */
 
-  Matrix<T,Dynamic, 1> y = x * std::cos(v.norm()) + v / v.norm() * std::sin(v.norm());
+  Matrix<T,dim, 1> y = x * std::cos(v.norm()) + v / v.norm() * std::sin(v.norm());
   return y;
 }
 
 
-template<typename T>
-Matrix<T, Dynamic, 1> karcherMean(const Matrix<T,Dynamic, Dynamic>& xDir_k)
+struct KarcherOptions
+{
+  /**
+   * @param tolerance the fixed point iteration stops once the norm of the mean tangent vector falls below it
+   * @param maxIter upper bound on the number of iterations; a degenerate group, e.g. directions spread over the whole
+   * sphere, may otherwise never reach the tolerance
+   */
+  double tolerance = 0.01;
+  int maxIter = 100;
+};
+
+
+
+template<typename T, int dim>
+struct KarcherResult
+{
+  Matrix<T, dim, 1> mean;
+  T scatter;          // sum of the squared geodesic distances to mean, i.e. riemScatter(xDir_k, mean)
+  int iterations;     // number of log map passes over the data
+  bool converged;
+};
+
+
+
+template<typename Derived>
+KarcherResult<typename Derived::Scalar, Derived::ColsAtCompileTime> karcherMean(const MatrixBase<Derived>& xDir_k, 
+  const KarcherOptions &opt, const Matrix<typename Derived::Scalar, Derived::ColsAtCompileTime, 1> *init = nullptr)
 {
   /**
    * This function computes the Fréchet mean in unit sphere
-   * 
-   * @param xDir_k denotes all the directional vectors belong to k_th group
-   * @param xTan is the point of tangency that is randomly initalized, updated, and eventually converged to the mean
-   * @param xDir is the directional part of xDir_k
+   *
+   * @param xDir_k denotes all the directional vectors belong to k_th group; any row block, e.g. a contiguous view into
+   * grouped data, is accepted without copy
+   * @param init optional unit starting point, e.g. the mean of the same component in the previous iteration; without
+   * it the iteration starts from the normalized Euclidean mean
+   * @param xTan is the point of tangency that is initalized, updated, and eventually converged to the mean
    * @param sumDir is the summation of the logrithmic map of all xDir_k w.r.t. xTan
    * @param meanDir is the point that awaits be mapped back to sphere as the new xTan
-   * 
+   *
+   * @note every pass of rie_log_sum also yields the squared geodesic distances; the scatter of the returned mean is
+   * therefore taken from the last pass instead of another one
+   *
+   * @note a pass producing a non-finite step or scatter, which happens for a degenerate group, ends the iteration
+   * with the result of the previous pass, i.e. at the last finite point of tangency; only a non-finite first pass
+   * returns its own result
+   * @note a zero step counts as converged whatever the tolerance, as the exponential map of a zero vector is undefined
    */
+  typedef typename Derived::Scalar T;
+  const int dim = Derived::ColsAtCompileTime;
 
-  int dim = xDir_k.cols();
   int num = xDir_k.rows();
 
-  float tolerance = 0.01;
-
-  // Matrix<T, Dynamic, 1> xTan = xDir_k(0, all).transpose();   // may subject to non-convergence
+  Matrix<T, dim, 1> xTan;
+  if (init != nullptr)
+    xTan = *init;
+  else {
+    xTan = xDir_k.colwise().sum().transpose();
+    xTan /= xTan.norm();
+  }
 
-  // better initialization
-  Eigen::Matrix<T, 1, Eigen::Dynamic> mean_vector = xDir_k.colwise().sum() / num;
-  mean_vector /= mean_vector.norm();
-  Eigen::Matrix<T, Eigen::Dynamic, 1> xTan = mean_vector.transpose();
+  KarcherResult<T, dim> result;
+  Matrix<T, dim, 1> sumDir(xDir_k.cols());
+  Matrix<T, dim, 1> meanDir(xDir_k.cols());
+  T sumSq;
 
-  Matrix<T, Dynamic, 1> xDir(dim);
-  Matrix<T, Dynamic, 1> sumDir(dim);
-  Matrix<T, Dynamic, 1> meanDir(dim);
+  for (int iter=1; ; ++iter)  {
+    rie_log_sum(xTan, xDir_k, sumDir, sumSq);
 
-  while (1)  { 
-    sumDir.setZero();
-    sumDir = rie_log(xTan, xDir_k).colwise().sum().transpose(); //vectorized operation (no clear speed diff)
+    meanDir = sumDir / num;
+    T step  = meanDir.norm();
+    bool finite = std::isfinite(step) && std::isfinite(sumSq);
 
-    // for (int i=0; i<num; ++i){
-    //   xDir = xDir_k(i, all).transpose();
-    //   sumDir = sumDir + rie_log(xTan, xDir);
-    // }
+    if (!finite && iter > 1)
+      return result;
 
-    meanDir = sumDir / num;
+    result.mean       = xTan;
+    result.scatter    = sumSq;
+    result.iterations = iter;
+    result.converged  = (step < opt.tolerance || step == 0);
 
-    if (meanDir.norm() < tolerance)
-      return xTan;
+    if (result.converged || iter >= opt.maxIter || !finite)
+      return result;
 
     xTan = rie_exp(xTan, meanDir);
   }
@@ -175,31 +308,37 @@ Matrix<T, Dynamic, 1> karcherMean(const Matrix<T,Dynamic, Dynamic>& xDir_k)
 
 
 
-template<typename T>
-T riemScatter(const Matrix<T,Dynamic, Dynamic>& xDir_k)
+template<typename Derived>
+Matrix<typename Derived::Scalar, Derived::ColsAtCompileTime, 1> karcherMean(const MatrixBase<Derived>& xDir_k)
 {
-  return riemScatter(xDir_k, karcherMean(xDir_k));
-}
+  return karcherMean(xDir_k, KarcherOptions()).mean;
+};
+
 
 
-template<typename T>
-T riemScatter(const Matrix<T,Dynamic, Dynamic>& xDir_k, const Matrix<T, Dynamic, 1>& mean)
+template<typename Derived>
+typename Derived::Scalar riemScatter(const MatrixBase<Derived>& xDir_k, 
+  const Matrix<typename Derived::Scalar, Derived::ColsAtCompileTime, 1>& mean)
 {
   /**
    * This function computes the empirical scatter on the Riemannian manifold
-   * 
+   *
    * @note karcherScatter is a wrong terminology, rather it is the empirical scatter on the tangent space
-   * 
+   *
    * @note this is SCATTER and NOT variance, this has not been divided by number of component
    */
 
-  int dim = xDir_k.cols();
-  int num = xDir_k.rows();
-
-  T scatter = 0;
-  for (int i = 0; i < num; ++i) {
-    Matrix<T, Dynamic, 1> xDir_i = xDir_k(i, all).transpose();
-    scatter = scatter + pow(rie_log(mean, xDir_i).norm(), 2); 
-  }
+  typedef typename Derived::Scalar T;
+  Matrix<T, Derived::ColsAtCompileTime, 1> sumDir(xDir_k.cols());
+  T scatter;
+  rie_log_sum(mean, xDir_k, sumDir, scatter);
   return scatter;
-}
\ No newline at end of file
+}
+
+
+
+template<typename Derived>
+typename Derived::Scalar riemScatter(const MatrixBase<Derived>& xDir_k)
+{
+  return riemScatter(xDir_k, karcherMean(xDir_k));
+}
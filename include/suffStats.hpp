@@ -0,0 +1,97 @@
+/*
+* Per-component sufficient statistics maintained across label changes
+*/
+
+#pragma once
+
+#include <vector>
+#include <Eigen/Dense>
+#include "execution.hpp"
+#include "membership.hpp"
+
+
+using namespace Eigen;
+
+
+enum class StatsMode
+{
+    /**
+     * How the label sweep keeps the per-component statistics in step with the labels
+     *
+     * @param incremental the moves of the sweep are applied afterwards in row order at O(d^2) each; bitwise
+     * reproducible from the seed; as the rounding of every move stays in the sums, they are rebuilt from the labels
+     * every few sweeps, see StatsStore::setRefresh()
+     * @param fused every thread accumulates the full statistics of the rows it labels while they are in cache, and the
+     * thread-local stores are merged by a tree reduction; no drift over long runs, but the rounding depends on the
+     * OpenMP schedule
+     */
+    incremental,
+    fused
+};
+
+
+
+template<typename T, int dim = Dynamic>
+struct SuffStats
+{
+    /**
+     * @param count number of member observations
+     * @param sum sum of the positions, centered at the shift of the owning StatsStore
+     * @param outer sum of the outer products of the centered positions
+     * @param sumDir sum of the unit directions, i.e. the resultant vector; unused by position-only stores
+     *
+     * @note centering every position at the global mean keeps outer - sum sum^T / count free of cancellation
+     */
+    int64_t count = 0;
+    Matrix<T,dim,1> sum;
+    Matrix<T,dim,dim> outer;
+    Matrix<T,dim,1> sumDir;
+
+    void setZero(uint32_t dimPos);
+    Matrix<T,dim,1> mean(const Matrix<T,dim,1> &shift) const {return shift + sum / T(count);};
+    Matrix<T,dim,dim> scatter() const {return outer - sum * sum.transpose() / T(count);};
+};
+
+
+
+template<typename T, int dim = Dynamic>
+class StatsStore
+{
+    public:
+        typedef Ref<const Matrix<T,1,Dynamic>, 0, InnerStride<>> row_t;   // one row of the column-major data, no copy
+
+        StatsStore(){};
+        ~StatsStore(){};
+
+        void build(const Matrix<T,Dynamic,Dynamic> &x, const VectorXi &z, uint32_t K, uint32_t dimPos, bool directional);
+        void rebuild(const Matrix<T,Dynamic,Dynamic> &x, IndexView indexList, uint32_t k);
+        StatsStore<T,dim> zeroLike() const;
+
+        // delta updates, x_i is the full row (position followed by direction) of one observation
+        void insert(const row_t &x_i, uint32_t k);
+        void move(const row_t &x_i, uint32_t from, uint32_t to);
+        void update(const Matrix<T,Dynamic,Dynamic> &x, const VectorXi &zOld, const VectorXi &zNew);
+        void accumulate(const StatsStore<T,dim> &delta);
+        void setRefresh(uint32_t every){refreshEvery_ = every;};
+        static void reduce(std::vector<StatsStore<T,dim>> &parts, const ExecutionContext &exec);
+
+        // relabeling
+        void select(const std::vector<int> &labels);
+        void merge(uint32_t from, uint32_t to);
+        void resize(uint32_t K);
+
+        const SuffStats<T,dim> & operator[](uint32_t k) const {return stats_[k];};
+        const Matrix<T,dim,1> & shift() const {return shift_;};
+        uint32_t size() const {return stats_.size();};
+
+
+    private:
+        void add(const row_t &x_i, SuffStats<T,dim> &stats, T sign) const;
+
+        std::vector<SuffStats<T,dim>> stats_;
+        Matrix<T,dim,1> shift_;
+        uint32_t dimPos_ = 0;
+        bool directional_ = false;
+        uint32_t refreshEvery_ = 0;     // update() rebuilds the statistics instead every that many calls; 0 never
+        uint32_t numUpdates_ = 0;
+};
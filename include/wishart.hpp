@@ -0,0 +1,72 @@
+/*
+* Inverse-Wishart draws in Cholesky form (Bartlett decomposition)
+*/
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <Eigen/Dense>
+#include <boost/random/chi_squared_distribution.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include "philox.hpp"
+#include "execution.hpp"
+
+
+using namespace Eigen;
+
+
+
+template<typename T, int dim>
+void sampleInvWishartChol(const Matrix<T,dim,dim> &cholScale, T nu, Philox4x32 &rndGen,
+  Matrix<T,dim,dim> &chol, Matrix<T,dim,dim> &invChol)
+{
+  /**
+   * This function draws a covariance from the inverse Wishart distribution IW(Psi, nu) directly as its Cholesky factor
+   *
+   * @param cholScale lower Cholesky factor C of the scale matrix, Psi = C C^T
+   * @param chol output, lower Cholesky factor of the drawn covariance Sigma = chol chol^T
+   * @param invChol output, chol^{-1}, lower triangular
+   *
+   * @note with the upper Bartlett factor A, i.e. A_ii^2 ~ chiSq(nu-(d-1-i)) and A_ij ~ N(0,1) for j>i, A A^T follows
+   * W(I, nu), hence Sigma = C (A A^T)^{-1} C^T = (C A^{-T}) (C A^{-T})^T; the upper factor makes C A^{-T} lower
+   * triangular, i.e. a Cholesky factor, and its inverse is A^T C^{-1}
+   *
+   * @note both factors come from one triangular solve each, no matrix is inverted nor factorized
+   */
+  const Index d = cholScale.rows();
+  Matrix<T,dim,dim> matrixA;
+  matrixA.setZero(d, d);
+
+  boost::random::normal_distribution<T> gauss_(0.0, 1.0);
+  for (Index i=0; i<d; ++i)  {
+    boost::random::chi_squared_distribution<T> chiSq_(nu - (d-1-i));
+    matrixA(i, i) = std::sqrt(chiSq_(rndGen));
+    for (Index j=i+1; j<d; ++j)
+      matrixA(i, j) = gauss_(rndGen);
+  }
+
+  chol    = matrixA.transpose().template triangularView<Lower>().template solve<OnTheRight>(cholScale);
+  invChol = cholScale.template triangularView<Lower>().template solve<OnTheRight>(Matrix<T,dim,dim>(matrixA.transpose()));
+}
+
+
+
+template<class dist_t>
+void sampleParameters(const std::vector<dist_t> &posteriors, std::vector<Philox4x32> &rndGens,
+  std::vector<typename dist_t::component_t> &components, const ExecutionContext &exec)
+{
+  /**
+   * This function draws the components of all K posteriors in one call
+   *
+   * @param rndGens one generator per posterior, continued from wherever its caller left it, so that the draws are
+   * the same as calling sampleParameter one by one
+   * @param components output, resized to K
+   */
+  const uint32_t K = posteriors.size();
+  components.resize(K);
+
+  #pragma omp parallel for num_threads(exec.threadsFor(K)) schedule(dynamic, 1)
+  for (uint32_t kk=0; kk<K; ++kk)
+    components[kk] = posteriors[kk].sampleParameter(rndGens[kk]);
+}
@@ -0,0 +1,95 @@
+#include <iostream>
+#include <cstdio>
+#include <vector>
+#include <Eigen/Dense>
+#include <boost/program_options.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include "philox.hpp"
+
+
+namespace po = boost::program_options;
+using namespace Eigen;
+
+
+
+int main(int argc, char **argv)
+{
+    /**
+     * Synthetic input of the DAMM sampler for the scaling benchmark, see bench/scaling.sh
+     *
+     * Every component is a straight stroke: positions are spread along a random segment with isotropic noise, and
+     * directions follow the segment with some angular noise; the observations are written in the format read by
+     * main, i.e. N, 2*dim, the rows (position, unit direction), then sigmaDir_0, nu_0, kappa_0, mu_0 and sigma_0
+     *
+     * @note the output ends without a newline, as main takes any further token as a label of the incremental mode
+     * @note observation i draws from the Philox stream (seed, 1, i), hence a given size always yields the same data
+     */
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("points"       , po::value<uint64_t>()->required()    , "number of observations")
+        ("components"   , po::value<int>()->default_value(20)  , "number of strokes the observations are drawn from")
+        ("dim"          , po::value<int>()->default_value(3)   , "dimension of the positions, 2 or 3")
+        ("seed"         , po::value<uint64_t>()->default_value(1), "random seed")
+    ;
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    }
+    catch (const po::error& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    const uint64_t N  = vm["points"].as<uint64_t>();
+    const int K       = std::max(1, vm["components"].as<int>());
+    const int dim     = vm["dim"].as<int>();
+    const uint64_t seed = vm["seed"].as<uint64_t>();
+    if (dim != 2 && dim != 3) {
+        std::cerr << "Error: dim must be either 2 or 3" << std::endl;
+        return 1;
+    }
+
+    boost::random::normal_distribution<double> gauss_(0.0, 1.0);
+    boost::random::uniform_real_distribution<double> uni_(-1.0, 1.0);
+
+    // strokes: start point and unit direction
+    std::vector<VectorXd> start(K), dir(K);
+    Philox4x32 strokeGen(seed, 0, 0);
+    for (int kk=0; kk<K; ++kk) {
+        start[kk] = VectorXd::NullaryExpr(dim, [&](){return 3 * uni_(strokeGen);});
+        dir[kk]   = VectorXd::NullaryExpr(dim, [&](){return gauss_(strokeGen);}).normalized();
+    }
+
+    std::printf("%llu\n%d\n", (unsigned long long)N, 2*dim);
+    VectorXd pos(dim), vel(dim), sum = VectorXd::Zero(2*dim);
+    for (uint64_t ii=0; ii<N; ++ii) {
+        Philox4x32 rndGen(seed, 1, ii);
+        const int kk = ii % K;
+        pos = start[kk] + (1 + uni_(rndGen)) * dir[kk];
+        vel = dir[kk];
+        for (int jj=0; jj<dim; ++jj) {
+          pos[jj] += 0.05 * gauss_(rndGen);
+          vel[jj] += 0.1 * gauss_(rndGen);
+        }
+        vel.normalize();
+        sum.head(dim) += pos;
+        sum.tail(dim) += vel;
+
+        for (int jj=0; jj<dim; ++jj)
+          std::printf("%.6f ", pos[jj]);
+        for (int jj=0; jj<dim; ++jj)
+          std::printf("%.6f ", vel[jj]);
+    }
+
+    // prior: sigmaDir_0, nu_0, kappa_0, mu_0 at the data mean, sigma_0 = 0.1 I
+    std::printf("\n0.1 %d 1", 2*dim - 1);
+    for (int jj=0; jj<2*dim; ++jj)
+      std::printf(" %.6f", sum[jj] / N);
+    for (int ii=0; ii<2*dim; ++ii)
+      for (int jj=0; jj<2*dim; ++jj)
+        std::printf(" %.1f", ii == jj ? 0.1 : 0.0);
+    return 0;
+}
@@ -1,5 +1,7 @@
 #include <iostream>
 #include <limits>
+#include <algorithm>
+#include <numeric>
 #include <boost/random/uniform_01.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
 #include <boost/random/gamma_distribution.hpp>
@@ -10,12 +12,15 @@
 #include "damm.hpp"
 #include "niw.hpp"
 #include "niwDamm.hpp"
+#include "wishart.hpp"
+#include "kdTree.hpp"
+#include "relabel.hpp"
 
 
 
 template <class dist_t> 
-Damm<dist_t>::Damm(const MatrixXd &x, int init_cluster, double alpha, const dist_t &H, const boost::mt19937 &rndGen)
-: alpha_(alpha), H_(H), rndGen_(rndGen), N_(x.rows())
+Damm<dist_t>::Damm(const MatrixXd &x, int init_cluster, double alpha, const dist_t &H, uint64_t seed)
+: alpha_(alpha), H_(H), seed_(seed), N_(x.rows())
 {
   dim_   = x.cols()/2;
   x_     = x;
@@ -28,9 +33,12 @@ Damm<dist_t>::Damm(const MatrixXd &x, int init_cluster, double alpha, const dist
   if (init_cluster == 1) 
     z.setZero();
   else if (init_cluster > 1)  {
+    const uint32_t stream = stream_++;
     boost::random::uniform_int_distribution<> uni_(0, init_cluster-1);
-    for (int ii=0; ii<N_; ++ii) 
-      z[ii] = uni_(rndGen_); 
+    for (int ii=0; ii<N_; ++ii) {
+      Philox4x32 rndGen(seed_, stream, ii);
+      z[ii] = uni_(rndGen); 
+    }
   }
   else  { 
     cout<< "Number of initial clusters not supported yet" << endl;
@@ -43,13 +51,15 @@ Damm<dist_t>::Damm(const MatrixXd &x, int init_cluster, double alpha, const dist
   // logZ_.push_back(z_);
   // logNum_.push_back(K_);
   this ->updateIndexLists();
+
+  stats_.build(x_, z_, K_, dim_, true);
 };
 
 
 
 template <class dist_t> 
-Damm<dist_t>::Damm(const MatrixXd &x, int init_cluster, double alpha, const dist_t &H, const boost::mt19937 &rndGen, VectorXi z)
-: alpha_(alpha), H_(H), rndGen_(rndGen), N_(x.rows())
+Damm<dist_t>::Damm(const MatrixXd &x, int init_cluster, double alpha, const dist_t &H, uint64_t seed, VectorXi z)
+: alpha_(alpha), H_(H), seed_(seed), N_(x.rows())
 {
   // incremental learning framework when assignment array, z is provided
 
@@ -78,9 +88,11 @@ Damm<dist_t>::Damm(const MatrixXd &x, int init_cluster, double alpha, const dist
   // std::cout << K_old << std::endl;
   // std::cout << indexList_new_.size() << std::endl;
 
+  const uint32_t stream = stream_++;
   boost::random::uniform_int_distribution<> uni_(1+K_old, K_old+init_cluster);
   for (int ii=0; ii<indexList_new_.size(); ++ii){
-    z[indexList_new_[ii]] = uni_(rndGen_);
+    Philox4x32 rndGen(seed_, stream, indexList_new_[ii]);
+    z[indexList_new_[ii]] = uni_(rndGen);
   }
 
   // std::cout << z << std::endl;
@@ -90,6 +102,8 @@ Damm<dist_t>::Damm(const MatrixXd &x, int init_cluster, double alpha, const dist
   // logZ_.push_back(z_);
   // logNum_.push_back(K_);
   this ->updateIndexLists();
+
+  stats_.build(x_, z_, K_, dim_, true);
 };
 
 
@@ -98,94 +112,311 @@ Damm<dist_t>::Damm(const MatrixXd &x, int init_cluster, double alpha, const dist
 template <class dist_t> 
 void Damm<dist_t>::sampleCoefficientsParameters()
 { 
-  parameters_.clear();
-  components_.clear();
-  vector<double> Pi;
-
-  for (uint32_t kk=0; kk<K_; ++kk)  {
-    if (indexLists_[kk].size() == 1) {}
-    else{
-    boost::random::gamma_distribution<> gamma_(indexLists_[kk].size(), 1); //size cannot be zero; shouldnt be 1 either for single data component
-    Pi.push_back(gamma_(rndGen_));
-    parameters_.push_back(H_.posterior(x_(indexLists_[kk], all)));
-    components_.push_back(parameters_.back().sampleParameter());
-    }
+  /**
+   * This method samples coefficients and parameters of every non-singleton component in parallel
+   *
+   * @note the positional statistics come from stats_ at O(d^2) per component; only the Karcher mean still visits the
+   * member directions
+   *
+   * @note compLabel_ maps the index of a sampled component back to its label, so that the sweep keeps writing labels
+   * in the space of stats_; reorderAssignments() later compacts both
+   *
+   * @note the singletons are compacted out first, so that every component writes its own preallocated slot; each
+   * works on a private copy of the base distribution, whose sufficient statistics are scratch space, and draws from
+   * the Philox stream of its label, hence the result does not depend on the schedule; the components of all the
+   * posteriors are then drawn by one batched call
+   *
+   * @note the Karcher mean of every component is warm-started from its mean direction of the previous iteration
+   */
+  compLabel_.clear();
+  for (uint32_t kk=0; kk<K_; ++kk)
+    if (stats_[kk].count != 1)
+      compLabel_.push_back(kk);
+
+  const uint32_t numComp = compLabel_.size();
+  const uint32_t stream  = stream_++;
+  if (warmDir_.size() < K_)
+    warmDir_.resize(K_);
+
+  parameters_.resize(numComp);
+  Pi_.resize(numComp);
+  vector<Philox4x32> rndGens;
+  rndGens.reserve(numComp);
+  for (uint32_t cc=0; cc<numComp; ++cc)
+    rndGens.emplace_back(seed_, stream, compLabel_[cc]);
+
+  #pragma omp parallel for num_threads(exec_.threadsFor(numComp)) schedule(dynamic, 1)
+  for (uint32_t cc=0; cc<numComp; ++cc)  {
+    const uint32_t kk = compLabel_[cc];
+    dist_t H = H_;
+    boost::random::gamma_distribution<> gamma_(stats_[kk].count, 1); //size cannot be zero; shouldnt be 1 either for single data component
+    Pi_(cc) = gamma_(rndGens[cc]);
+
+    typename dist_t::dir_t warmDir;
+    if (warmDir_[kk].size() > 0)
+      warmDir = warmDir_[kk];
+    const typename dist_t::dir_t *warm = (warmDir_[kk].size() > 0) ? &warmDir : nullptr;
+
+    if (grouped_)
+      parameters_[cc] = H.posterior(stats_[kk], stats_.shift(), 
+        x_.middleRows(indexLists_.offset(kk), indexLists_.count(kk)).rightCols(dim_), warm);
+    else
+      parameters_[cc] = H.posterior(stats_[kk], stats_.shift(), x_(indexLists_[kk], seq(dim_, last)), warm);
+    warmDir_[kk] = parameters_[cc].getMuDir();
   }
-  K_ = Pi.size();
-  Pi_ = Eigen::Map<Eigen::VectorXd>(Pi.data(), K_);
+  sampleParameters(parameters_, rndGens, components_, exec_);
+  if (subClusters_)
+    this ->sampleSubClusterParameters();
+  K_ = numComp;
   Pi_ = Pi_ / Pi_.sum();
 }
 
 
+template <class dist_t> 
+void Damm<dist_t>::sampleSubClusterParameters()
+{ 
+  /**
+   * This method samples the weights and the position components of the two sub-clusters of every sampled component
+   *
+   * @note the weights of a pair follow Dir(N_0 + alpha/2, N_1 + alpha/2); an empty sub-cluster draws its component
+   * from the prior, so that it can still attract observations
+   */
+  const uint32_t numComp = compLabel_.size();
+  const uint32_t stream  = stream_++;
+
+  subComponents_.resize(2*numComp);
+  subPi_.resize(2*numComp);
+
+  #pragma omp parallel for num_threads(exec_.threadsFor(numComp)) schedule(dynamic, 1)
+  for (uint32_t cc=0; cc<numComp; ++cc)  {
+    const uint32_t kk = compLabel_[cc];
+    Philox4x32 rndGen(seed_, stream, kk);
+    typename dist_t::niw_t H = * H_.NIW_ptr;
+    for (uint32_t ll=0; ll<2; ++ll) {
+      const auto &stats = subStats_[2*kk+ll];
+      boost::random::gamma_distribution<> gamma_(stats.count + alpha_/2, 1);
+      subPi_(2*cc+ll) = gamma_(rndGen);
+      if (stats.count > 0)
+        subComponents_[2*cc+ll] = H.posterior(stats, subStats_.shift()).sampleParameter(rndGen);
+      else
+        subComponents_[2*cc+ll] = H.sampleParameter(rndGen);
+    }
+    subPi_.segment(2*cc, 2) /= subPi_.segment(2*cc, 2).sum();
+  }
+}
+
+
 template <class dist_t> 
 void Damm<dist_t>::sampleLabels_increm()
 {
-  // double logLik = 0;
-  #pragma omp parallel for num_threads(8) schedule(dynamic, 300) private(rndGen_)
-  for(uint32_t ii=0; ii<indexList_new_.size(); ++ii) {
-    VectorXd prob(K_);
-    // double logLik_i = 0;
-
-    for (uint32_t kk=0; kk<K_; ++kk) { 
-      double logProb =  components_[kk].logProb(x_(indexList_new_[ii], all));
-      prob[kk] = log(Pi_[kk]) + logProb;
-      // logLik_i += Pi_[kk] * exp(logProb);
-    }
-    // logLik += log(logLik_i);
-    double max_prob = prob.maxCoeff();
-    prob = (prob.array() - max_prob).exp() / (prob.array() - max_prob).exp().sum();
-    // prob = (prob.array()-(prob.maxCoeff() + log((prob.array() - prob.maxCoeff()).exp().sum()))).exp().matrix();
-    prob = prob / prob.sum();
-    for (uint32_t kk = 1; kk < prob.size(); ++kk) 
-      prob[kk] = prob[kk-1]+ prob[kk];
-    
+  /**
+   * This method samples the labels of the newly added observations only; the rows of every block are gathered
+   * before being handed to the batched engine
+   */
+  if (mixed_) {
+    this ->packEngineF();
+    this ->sweepLabels_increm(engineF_, xf_);
+  }
+  else {
+    engine_.pack(components_, Pi_);
+    this ->sweepLabels_increm(engine_, x_);
+  }
+}
+
+
+template <class dist_t> 
+void Damm<dist_t>::sampleLabels()
+{
+  /**
+   * This method samples the labels of all observations block by block
+   * 
+   * @note the engine evaluates log(Pi_k) + logProb_k for a whole block of rows and all K components at once,
+   * so no per-pair temporary or solve is involved
+   *
+   * @note when tracking is enabled, the log mixture likelihood of every observation falls out of the normalizer of
+   * its draw and is reduced over all threads into logLogLik_
+   */
+  if (mixed_) {
+    this ->packEngineF();
+    this ->sweepLabels(engineF_, xf_);
+  }
+  else {
+    engine_.pack(components_, Pi_);
+    this ->sweepLabels(engine_, x_);
+  }
+}
+
+
+template <class dist_t> 
+void Damm<dist_t>::packEngineF()
+{
+  /**
+   * This method rounds the sampled components to float and packs them into the float engine
+   */
+  vector<typename dist_t::componentf_t> componentsF;
+  componentsF.reserve(components_.size());
+  for (const auto &comp : components_)
+    componentsF.push_back(comp.template cast<float>());
+  engineF_.pack(componentsF, Pi_);
+}
+
+
+template <class dist_t> 
+template <typename T>
+void Damm<dist_t>::sweepLabels_increm(const LogLikEngine<T> &engine, const Matrix<T,Dynamic,Dynamic> &x)
+{
+  const uint32_t numNew    = indexList_new_.size();
+  const uint32_t blockRows = exec_.chunkRows(numNew, engine.blockRows());
+  const uint32_t numBlocks = (numNew + blockRows - 1) / blockRows;
+  const uint32_t stream    = stream_++;
+
+  const VectorXi zOld = z_;
+
+  double logLikSum = 0;
+  #pragma omp parallel for num_threads(exec_.threadsFor(numBlocks)) schedule(dynamic, 1) reduction(+:logLikSum)
+  for (uint32_t bb=0; bb<numBlocks; ++bb) {
+    uint32_t begin = bb * blockRows;
+    uint32_t rows  = std::min(blockRows, numNew - begin);
+    vector<int> indexBlock(indexList_new_.begin() + begin, indexList_new_.begin() + begin + rows);
+
+    Matrix<T,Dynamic,Dynamic> logLik(rows, K_);
+    engine.compute(x(indexBlock, all), logLik);
+
     boost::random::uniform_01<> uni_;   
-    double uni_draw = uni_(rndGen_);
-    uint32_t kk = 0;
-    while (prob[kk] < uni_draw) 
-      kk++;
-    z_[indexList_new_[ii]] = kk;
+    for (uint32_t ii=0; ii<rows; ++ii) {
+      Philox4x32 rndGen(seed_, stream, indexBlock[ii]);
+      double logLik_i = 0;
+      z_[indexBlock[ii]] = compLabel_[sampleLogProb(logLik.row(ii), uni_(rndGen), trackLogLik_ ? &logLik_i : nullptr)];
+      logLikSum += logLik_i;
+    }
   } 
-  // logLogLik_.push_back(logLik);
+  stats_.update(x_, zOld, z_);
+  if (trackLogLik_)
+    logLogLik_.push_back(logLikSum);
   // logZ_.push_back(z_);
 }
 
+
 template <class dist_t> 
-void Damm<dist_t>::sampleLabels()
+template <typename T>
+void Damm<dist_t>::sweepLabels(const LogLikEngine<T> &engine, const Matrix<T,Dynamic,Dynamic> &x)
 {
-  // double logLik = 0;
-  #pragma omp parallel for num_threads(8) schedule(dynamic, 300) private(rndGen_)
-  for(uint32_t ii=0; ii<N_; ++ii) {
-    VectorXd prob(K_);
-    // double logLik_i = 0;
-
-    for (uint32_t kk=0; kk<K_; ++kk) { 
-      double logProb =  components_[kk].logProb(x_(ii, all));
-      prob[kk] = log(Pi_[kk]) + logProb;
-      // logLik_i += Pi_[kk] * exp(logProb);
-    }
-    // logLik += log(logLik_i);
-    double max_prob = prob.maxCoeff();
-    prob = (prob.array() - max_prob).exp() / (prob.array() - max_prob).exp().sum();
-    // prob = (prob.array()-(prob.maxCoeff() + log((prob.array() - prob.maxCoeff()).exp().sum()))).exp().matrix();
-    prob = prob / prob.sum();
-    for (uint32_t kk = 1; kk < prob.size(); ++kk) 
-      prob[kk] = prob[kk-1]+ prob[kk];
+  const uint32_t blockRows = exec_.chunkRows(N_, engine.blockRows());
+  const uint32_t numBlocks = (N_ + blockRows - 1) / blockRows;
+  const uint32_t stream    = stream_++;
+
+  const int  numThreads = exec_.threadsFor(numBlocks);
+  const bool fused      = (statsMode_ == StatsMode::fused);
+  vector<typename dist_t::stats_t> partials(fused ? numThreads : 0, stats_.zeroLike());
+  const VectorXi zOld = fused ? VectorXi() : z_;
+  const VectorXi subOld = subClusters_ ? VectorXi(2*z_ + zSub_) : VectorXi();
+
+  double logLikSum = 0;
+  #pragma omp parallel for num_threads(numThreads) schedule(dynamic, 1) reduction(+:logLikSum)
+  for (uint32_t bb=0; bb<numBlocks; ++bb) {
+    uint32_t begin = bb * blockRows;
+    uint32_t rows  = std::min(blockRows, N_ - begin);
+
+    Matrix<T,Dynamic,Dynamic> logLik(rows, K_);
+    engine.compute(x.middleRows(begin, rows), logLik);
     
     boost::random::uniform_01<> uni_;   
-    double uni_draw = uni_(rndGen_);
-    uint32_t kk = 0;
-    while (prob[kk] < uni_draw) 
-      kk++;
-    z_[ii] = kk;
+    for (uint32_t ii=0; ii<rows; ++ii) {
+      Philox4x32 rndGen(seed_, stream, begin+ii);
+      double logLik_i = 0;
+      uint32_t cc = sampleLogProb(logLik.row(ii), uni_(rndGen), trackLogLik_ ? &logLik_i : nullptr);
+      z_[begin+ii] = compLabel_[cc];
+      if (subClusters_) {
+        const typename dist_t::dir_t xPos = x_.row(begin+ii).head(dim_).transpose();
+        double logRatio = log(subPi_(2*cc)) + subComponents_[2*cc].logProb(xPos) 
+                        - log(subPi_(2*cc+1)) - subComponents_[2*cc+1].logProb(xPos);
+        zSub_[begin+ii] = uni_(rndGen) * (1 + exp(logRatio)) < 1;
+      }
+      if (fused)
+        partials[omp_get_thread_num()].insert(x_.row(begin+ii), z_[begin+ii]);
+      logLikSum += logLik_i;
+    }
   } 
-  // logLogLik_.push_back(logLik);
+
+  if (fused) {
+    dist_t::stats_t::reduce(partials, exec_);
+    stats_ = std::move(partials[0]);
+  }
+  else
+    stats_.update(x_, zOld, z_);
+  if (subClusters_) {
+    subStats_.update(x_, subOld, 2*z_ + zSub_);
+    for (auto &age : subAge_)
+      ++age;
+  }
+  if (trackLogLik_)
+    logLogLik_.push_back(logLikSum);
   // logZ_.push_back(z_);
 }
 
 
 template <class dist_t> 
-int Damm<dist_t>::splitProposal(const vector<int> &indexList)
+void Damm<dist_t>::setPrecision(bool mixed)
+{
+  /**
+   * This method selects the precision of the label sweep
+   *
+   * @param mixed when true, the likelihood sweep streams a float copy of x_ through a float engine, which halves
+   * the memory traffic and doubles the SIMD width; sufficient statistics, Karcher means and posterior sampling
+   * keep working on the double x_
+   */
+  mixed_ = mixed;
+  if (mixed_)
+    xf_ = x_.template cast<float>();
+  else
+    xf_.resize(0, 0);
+}
+
+
+template <class dist_t> 
+double Damm<dist_t>::labelAgreement()
+{
+  /**
+   * This method measures how often the float sweep agrees with the double one under the current components
+   *
+   * @return the fraction of observations whose most probable label is the same in both precisions
+   *
+   * @note the sampled labels cannot be compared directly as they are random; the argmax of every row is
+   * deterministic and only flips for observations lying on a decision boundary within float round-off
+   */
+  if (xf_.size() == 0)
+    xf_ = x_.template cast<float>();
+
+  engine_.pack(components_, Pi_);
+  this ->packEngineF();
+
+  const uint32_t blockRows = exec_.chunkRows(N_, engine_.blockRows());
+  const uint32_t numBlocks = (N_ + blockRows - 1) / blockRows;
+  uint32_t agree = 0;
+
+  #pragma omp parallel for num_threads(exec_.threadsFor(numBlocks)) schedule(dynamic, 1) reduction(+:agree)
+  for (uint32_t bb=0; bb<numBlocks; ++bb) {
+    uint32_t begin = bb * blockRows;
+    uint32_t rows  = std::min(blockRows, N_ - begin);
+
+    MatrixXd logLik(rows, engine_.getK());
+    MatrixXf logLikF(rows, engineF_.getK());
+    engine_.compute(x_.middleRows(begin, rows), logLik);
+    engineF_.compute(xf_.middleRows(begin, rows), logLikF);
+
+    for (uint32_t ii=0; ii<rows; ++ii) {
+      Index k, kF;
+      logLik.row(ii).maxCoeff(&k);
+      logLikF.row(ii).maxCoeff(&kF);
+      agree += (k == kF);
+    }
+  }
+  return double(agree) / N_;
+}
+
+
+template <class dist_t> 
+int Damm<dist_t>::splitProposal(IndexView indexList)
 { 
   /**
    * This method proposes a split of the given indexList
@@ -195,51 +426,160 @@ int Damm<dist_t>::splitProposal(const vector<int> &indexList)
    * @note Notice in split proposals, no need to call reorderAssignments(), as the newly added group are already 
    * taken care by z_split_i
    */
+  Philox4x32 rndGen(seed_, stream_++, indexList[0]);
 
+  vector<int> indexList_i;
+  vector<int> indexList_j;
+  double logAcceptanceRatio;
+  uint32_t numScans;
+  bool accepted = this ->proposeSplit(indexList, rndGen.spawnSeed(), exec_, indexList_i, indexList_j, 
+    logAcceptanceRatio, numScans);
+  logScans_.push_back(numScans);
+  if (!accepted)
+    return 1;
 
-  uint32_t z_split_i = z_.maxCoeff() + 1;
-  uint32_t z_split_j = z_[indexList[0]];
+  this ->acceptSplit(indexList_i, indexList_j, logAcceptanceRatio);
+  return 0;
+}
 
 
-  Dpmm<Niw<double>> dpmm_split(x_, z_, indexList, alpha_, * H_.NIW_ptr, rndGen_);
-  
- 
-  for (int tt=0; tt<50; ++tt) {
-    dpmm_split.sampleCoefficientsParameters(indexList);
-    dpmm_split.sampleLabels(indexList);
-    if (dpmm_split.indexLists_[0].empty()==true || dpmm_split.indexLists_[1].empty()==true)
-      return 1;
+template <class dist_t> 
+int Damm<dist_t>::splitProposals(const Membership &indexLists, uint32_t minSize, uint32_t maxProposals, 
+  uint32_t *numProposed)
+{ 
+  /**
+   * This method proposes a split of every component holding more than minSize observations, all proposals being
+   * evaluated concurrently
+   *
+   * @param maxProposals when non-zero, only that many of the largest candidates are proposed
+   * @param numProposed output, if given, the number of proposals
+   * @return the number of accepted splits
+   *
+   * @note the number of restricted Gibbs scans of every proposal is appended to logScans_ and summed up on stdout
+   *
+   * @note every proposal runs its own restricted Dpmm on a Philox stream keyed by the first observation of its
+   * component, so that the outcome does not depend on the number of threads nor on the order of evaluation; it
+   * copies the positions of its component only, hence the proposals in flight hold O(N) rows together
+   * @note the components are disjoint, hence so are the proposals; the accepted ones are committed afterwards in
+   * component order, each taking the next free label
+   */
+  vector<uint32_t> candidates;
+  for (uint32_t kk=0; kk<indexLists.size(); ++kk)
+    if (indexLists[kk].size() > minSize)
+      candidates.push_back(kk);
+
+  if (maxProposals > 0 && candidates.size() > maxProposals) {
+    std::stable_sort(candidates.begin(), candidates.end(), 
+      [&](uint32_t a, uint32_t b){return indexLists[a].size() > indexLists[b].size();});
+    candidates.resize(maxProposals);
+    std::sort(candidates.begin(), candidates.end());
+  }
+  if (numProposed)
+    *numProposed = candidates.size();
+
+  const uint32_t numCandidates = candidates.size();
+  const uint32_t stream        = stream_++;
+  const int numThreads         = exec_.threadsFor(numCandidates);
+  const ExecutionContext exec  = exec_.share(numThreads);
+
+  vector<uint8_t> accepted(numCandidates);
+  vector<vector<int>> indexLists_i(numCandidates);
+  vector<vector<int>> indexLists_j(numCandidates);
+  vector<double> logAcceptanceRatios(numCandidates);
+  vector<uint32_t> numScans(numCandidates);
+
+  #pragma omp parallel for num_threads(numThreads) schedule(dynamic, 1)
+  for (uint32_t cc=0; cc<numCandidates; ++cc) {
+    IndexView indexList = indexLists[candidates[cc]];
+    Philox4x32 rndGen(seed_, stream, indexList[0]);
+    accepted[cc] = this ->proposeSplit(indexList, rndGen.spawnSeed(), exec, indexLists_i[cc], indexLists_j[cc], 
+      logAcceptanceRatios[cc], numScans[cc]);
   }
 
+  int numAccepted = 0;
+  uint64_t totalScans = 0;
+  for (uint32_t cc=0; cc<numCandidates; ++cc) {
+    logScans_.push_back(numScans[cc]);
+    totalScans += numScans[cc];
+    if (accepted[cc]) {
+      this ->acceptSplit(indexLists_i[cc], indexLists_j[cc], logAcceptanceRatios[cc]);
+      ++numAccepted;
+    }
+  }
+  std::cout << "Split proposals: " << numAccepted << " of " << numCandidates << " accepted after " << totalScans
+            << " restricted Gibbs scans (at most " << uint64_t(numCandidates) * launch_.maxScans << ")" << std::endl;
+  return numAccepted;
+}
+
+
+template <class dist_t> 
+bool Damm<dist_t>::proposeSplit(IndexView indexList, uint64_t seed, const ExecutionContext &exec, 
+  vector<int> &indexList_i, vector<int> &indexList_j, double &logAcceptanceRatio, uint32_t &numScans) const
+{ 
+  /**
+   * This method runs the restricted Gibbs sampler of a split proposal without touching the state of the sampler
+   *
+   * @param seed the key of the restricted sampler
+   * @param indexList_i, indexList_j output, the two sub-clusters
+   * @param numScans output, the number of restricted Gibbs scans, see LaunchOptions
+   * @return whether the split is accepted
+   *
+   * @note the restricted sampler only holds the rows of indexList, and the sub-clusters are mapped back to
+   * observations of x_ once accepted
+   */
+  Dpmm<typename dist_t::niw_t> dpmm_split(x_, indexList, alpha_, * H_.NIW_ptr, seed, exec, launch_);
+  dpmm_split.setGrouping(grouped_);
   
-  vector<int> indexList_i = dpmm_split.indexLists_[0];
-  vector<int> indexList_j = dpmm_split.indexLists_[1];
+ 
+  numScans = dpmm_split.launch(launch_);
+  const Membership &subClusters = dpmm_split.indexLists_;
+  if (subClusters[0].empty()==true || subClusters[1].empty()==true)
+    return false;
 
 
-  double logAcceptanceRatio = 0;
+  logAcceptanceRatio = 0;
 
-  logAcceptanceRatio -= dpmm_split.logProposalRatio(indexList_i, indexList_j);
-  logAcceptanceRatio += dpmm_split.logTargetRatio(indexList_i, indexList_j);
+  logAcceptanceRatio -= dpmm_split.logProposalRatio(subClusters[0], subClusters[1]);
+  logAcceptanceRatio += dpmm_split.logTargetRatio(subClusters[0], subClusters[1]);
+  if (logAcceptanceRatio <= 0)
+    return false;
 
-  if (logAcceptanceRatio > 0) {
-    z_(indexList_i) = VectorXi::Constant(indexList_i.size(), z_split_i);
-    z_(indexList_j) = VectorXi::Constant(indexList_j.size(), z_split_j);
+  indexList_i = dpmm_split.globalIndices(subClusters[0]);
+  indexList_j = dpmm_split.globalIndices(subClusters[1]);
+  return true;
+}
 
-    // logZ_.push_back(z_);
-    K_ += 1;
-    // logNum_.push_back(K_);
-    std::cout << "Component " << z_split_j + 1 <<": Split proposal Aceepted with Log Acceptance Ratio " << logAcceptanceRatio << std::endl;
-    return 0;
-  }
-  else{
-    // std::cout << "Component " << z_split_j + 1 <<": Split proposal Rejected with Log Acceptance Ratio " << logAcceptanceRatio << std::endl;
-    return 1;
+
+template <class dist_t> 
+void Damm<dist_t>::acceptSplit(IndexView indexList_i, IndexView indexList_j, double logAcceptanceRatio)
+{ 
+  /**
+   * This method commits an accepted split: indexList_i moves to a new label, indexList_j keeps the original one
+   */
+  uint32_t z_split_i = z_.maxCoeff() + 1;
+  uint32_t z_split_j = z_[indexList_j[0]];
+
+  z_(indexList_i) = VectorXi::Constant(indexList_i.size(), z_split_i);
+  stats_.rebuild(x_, indexList_i, z_split_i);
+  stats_.rebuild(x_, indexList_j, z_split_j);
+  warmDir_.resize(std::max<size_t>(warmDir_.size(), z_split_i+1));
+  warmDir_[z_split_i].resize(0);
+  warmDir_[z_split_j].resize(0);
+  if (subClusters_) {
+    const uint32_t stream = stream_++;
+    this ->initSubClusters(indexList_i, z_split_i, Philox4x32(seed_, stream, z_split_i).spawnSeed());
+    this ->initSubClusters(indexList_j, z_split_j, Philox4x32(seed_, stream, z_split_j).spawnSeed());
   }
+
+  // logZ_.push_back(z_);
+  K_ += 1;
+  // logNum_.push_back(K_);
+  std::cout << "Component " << z_split_j + 1 <<": Split proposal Aceepted with Log Acceptance Ratio " << logAcceptanceRatio << std::endl;
 }
 
 
 template <class dist_t> 
-int Damm<dist_t>::mergeProposal(const vector<int> &indexList_i, const vector<int> &indexList_j)
+int Damm<dist_t>::mergeProposal(IndexView indexList_i, IndexView indexList_j)
 {  
   /**
    * This method proposes a merge between two given indexList_i and indexList_j
@@ -267,24 +607,37 @@ int Damm<dist_t>::mergeProposal(const vector<int> &indexList_i, const vector<int
   indexList.insert( indexList.end(), indexList_j.begin(), indexList_j.end() );
 
 
-  Dpmm<Niw<double>> dpmm_merge(x_, z_, indexList, alpha_, * H_.NIW_ptr, rndGen_);  
-  for (int tt=0; tt<50; ++tt)  {    
-    dpmm_merge.sampleCoefficientsParameters(indexList);
-    dpmm_merge.sampleLabels(indexList);
-    if (dpmm_merge.indexLists_[0].empty()==true || dpmm_merge.indexLists_[1].empty()==true) {
-      z_(indexList) = VectorXi::Constant(indexList.size(), z_merge_j);
-      std::cout << "Component " << z_merge_j + 1 << " and " << z_merge_i + 1 <<": Merge proposal Accepted" << std::endl;
-      return 0;
-    }
+  Philox4x32 rndGen(seed_, stream_++, indexList[0]);
+  Dpmm<typename dist_t::niw_t> dpmm_merge(x_, indexList, alpha_, * H_.NIW_ptr, rndGen.spawnSeed(), exec_, launch_);
+  dpmm_merge.setGrouping(grouped_);
+  logScans_.push_back(dpmm_merge.launch(launch_));
+  if (dpmm_merge.indexLists_[0].empty()==true || dpmm_merge.indexLists_[1].empty()==true) {
+    z_(indexList) = VectorXi::Constant(indexList.size(), z_merge_j);
+    stats_.merge(z_merge_i, z_merge_j);
+    warmDir_[z_merge_j].resize(0);
+    if (subClusters_)
+      this ->mergeSubClusters(indexList_i, indexList_j, z_merge_j);
+    std::cout << "Component " << z_merge_j + 1 << " and " << z_merge_i + 1 <<": Merge proposal Accepted" << std::endl;
+    return 0;
   }
 
+  // the original split state in the local rows of dpmm_merge, which are indexList_i followed by indexList_j
+  vector<int> localList_i(indexList_i.size());
+  vector<int> localList_j(indexList_j.size());
+  std::iota(localList_i.begin(), localList_i.end(), 0);
+  std::iota(localList_j.begin(), localList_j.end(), int(indexList_i.size()));
+
   double logAcceptanceRatio = 0;
 
-  logAcceptanceRatio += dpmm_merge.logProposalRatio(indexList_i, indexList_j);
-  logAcceptanceRatio -= dpmm_merge.logTargetRatio(indexList_i, indexList_j);
+  logAcceptanceRatio += dpmm_merge.logProposalRatio(localList_i, localList_j);
+  logAcceptanceRatio -= dpmm_merge.logTargetRatio(localList_i, localList_j);
 
   if (logAcceptanceRatio > 0) {
     z_(indexList) = VectorXi::Constant(indexList.size(), z_merge_j);
+    stats_.merge(z_merge_i, z_merge_j);
+    warmDir_[z_merge_j].resize(0);
+    if (subClusters_)
+      this ->mergeSubClusters(indexList_i, indexList_j, z_merge_j);
     std::cout << "Component " << z_merge_j << " and " << z_merge_i <<": Merge proposal Accepted with Log Acceptance Ratio " << logAcceptanceRatio << std::endl;
     return 0;
   }
@@ -295,34 +648,198 @@ int Damm<dist_t>::mergeProposal(const vector<int> &indexList_i, const vector<int
 
 
 
+template <class dist_t> 
+int Damm<dist_t>::mergeProposals(uint32_t maxProposals, int similarity, uint32_t minSize, uint32_t maxAccepted, 
+  uint32_t *numProposed)
+{  
+  /**
+   * This method proposes merges between the most similar pairs of components, one after the other
+   *
+   * @param maxProposals number of candidate pairs, see computeSimilarity(); 0 takes as many as components
+   * @param similarity how the pairs are selected, see computeSimilarity()
+   * @param minSize only pairs of more than minSize observations together are proposed
+   * @param maxAccepted the round stops after this many accepted merges; 0 never stops early
+   * @param numProposed output, if given, the number of proposals
+   * @return the number of accepted merges
+   *
+   * @note a component takes part in at most one accepted merge per round, as the index lists of merged ones are
+   * stale; reorderAssignments() must be called afterwards
+   * @note the index lists are read in place from indexLists_, which no merge rebuilds
+   */
+  const Membership &indexLists = this ->getIndexLists();
+  vector<array<int, 2>> pairs = this ->computeSimilarity(maxProposals > 0 ? maxProposals : K_, similarity);
+  vector<uint8_t> merged(indexLists.size(), 0);
+
+  int numAccepted = 0;
+  uint32_t proposed = 0;
+  for (const auto &ij : pairs) {
+    if (ij[0] < 0 || ij[1] < 0 || ij[0] >= int(indexLists.size()) || ij[1] >= int(indexLists.size()))
+      continue;
+    if (merged[ij[0]] || merged[ij[1]] || indexLists[ij[0]].size() + indexLists[ij[1]].size() <= minSize)
+      continue;
+
+    ++proposed;
+    if (!this ->mergeProposal(indexLists[ij[0]], indexLists[ij[1]])) {
+      merged[ij[0]] = merged[ij[1]] = 1;
+      if (++numAccepted == int(maxAccepted))
+        break;
+    }
+  }
+
+  if (numProposed)
+    *numProposed = proposed;
+  return numAccepted;
+}
+
+
+template <class dist_t> 
+int Damm<dist_t>::subClusterSplits()
+{ 
+  /**
+   * This method proposes to split every component into its two sub-clusters
+   *
+   * @return the number of accepted splits
+   *
+   * @note the proposal is deterministic given the sub-clusters, so no restricted Gibbs scan is needed and the Hastings
+   * ratio reduces to alpha Gamma(N_0) f(x_0) Gamma(N_1) f(x_1) / (Gamma(N) f(x)), f being the marginal likelihood of
+   * the positions under the prior [Chang & Fisher, Parallel Sampling of DP Mixture Models using Sub-Cluster Splits]
+   * @note sub-clusters younger than subBurnIn_ sweeps are not proposed yet
+   * @note indexLists_ must be up to date, i.e. called right after updateIndexLists()
+   */
+  if (!subClusters_)
+    return 0;
+
+  typename dist_t::niw_t H = * H_.NIW_ptr;
+  const uint32_t K = indexLists_.size();
+
+  int numAccepted = 0;
+  for (uint32_t kk=0; kk<K; ++kk) {
+    const auto &stats_0 = subStats_[2*kk];
+    const auto &stats_1 = subStats_[2*kk+1];
+    if (subAge_[kk] < int(subBurnIn_) || stats_0.count == 0 || stats_1.count == 0)
+      continue;
+
+    double logAcceptanceRatio = log(alpha_);
+    logAcceptanceRatio += lgamma(double(stats_0.count)) + H.logMarginal(stats_0, subStats_.shift());
+    logAcceptanceRatio += lgamma(double(stats_1.count)) + H.logMarginal(stats_1, subStats_.shift());
+    logAcceptanceRatio -= lgamma(double(stats_[kk].count)) + H.logMarginal(stats_[kk], stats_.shift());
+    if (logAcceptanceRatio <= 0)
+      continue;
+
+    vector<int> indexList_i;
+    vector<int> indexList_j;
+    for (int ii : indexLists_[kk])
+      (zSub_[ii] ? indexList_i : indexList_j).push_back(ii);
+    this ->acceptSplit(indexList_i, indexList_j, logAcceptanceRatio);
+    ++numAccepted;
+  }
+  return numAccepted;
+}
+
+
+template <class dist_t> 
+void Damm<dist_t>::setSubClusters(bool enabled, uint32_t burnIn)
+{ 
+  /**
+   * This method enables the persistent sub-clusters, see subClusterSplits()
+   *
+   * @param burnIn number of sweeps fresh sub-clusters are resampled before being proposed as a split
+   *
+   * @note the sub-clusters of every component start from a two-means clustering of its observations; they are only
+   * resampled by the full sweep, sampleLabels()
+   */
+  subClusters_ = enabled;
+  subBurnIn_   = burnIn;
+  if (!subClusters_) {
+    zSub_.resize(0);
+    subAge_.clear();
+    return;
+  }
+
+  zSub_.setZero(N_);
+  subStats_.build(x_, VectorXi(2*z_), 2*indexLists_.size(), dim_, false);
+  subAge_.assign(indexLists_.size(), 0);
+
+  const uint32_t stream = stream_++;
+  for (uint32_t kk=0; kk<indexLists_.size(); ++kk)
+    this ->initSubClusters(indexLists_[kk], kk, Philox4x32(seed_, stream, kk).spawnSeed());
+}
+
+
+template <class dist_t> 
+void Damm<dist_t>::initSubClusters(IndexView indexList, uint32_t k, uint64_t seed)
+{ 
+  /**
+   * This method splits the observations of label k into two fresh sub-clusters by two-means
+   */
+  vector<int> zKmeans = twoMeans(x_(indexList, seq(0, dim_-1)), seed, 0, launch_.kmeans, exec_);
+
+  vector<int> subLists[2];
+  for (uint32_t ii=0; ii<indexList.size(); ++ii) {
+    zSub_[indexList[ii]] = zKmeans[ii];
+    subLists[zKmeans[ii]].push_back(indexList[ii]);
+  }
+  subStats_.rebuild(x_, subLists[0], 2*k);
+  subStats_.rebuild(x_, subLists[1], 2*k+1);
+
+  if (subAge_.size() <= k)
+    subAge_.resize(k+1, 0);
+  subAge_[k] = 0;
+}
+
+
+template <class dist_t> 
+void Damm<dist_t>::mergeSubClusters(IndexView indexList_i, IndexView indexList_j, uint32_t k)
+{ 
+  /**
+   * This method makes the two merged components the sub-clusters of the merged label k
+   */
+  zSub_(indexList_i).setZero();
+  zSub_(indexList_j).setOnes();
+  subStats_.rebuild(x_, indexList_i, 2*k);
+  subStats_.rebuild(x_, indexList_j, 2*k+1);
+  subAge_[k] = 0;
+}
+
+
+
+
 template <class dist_t>
 void Damm<dist_t>::reorderAssignments()  //mainly called after clusters vanish during parallel sampling
 { 
-
-  vector<uint8_t> rearrange_list;
-  for (uint32_t ii=0; ii<N_; ++ii)
-  {
-    if (rearrange_list.empty()) rearrange_list.push_back(z_[ii]);
-    vector<uint8_t>::iterator it;
-    it = find (rearrange_list.begin(), rearrange_list.end(), z_[ii]);
-    if (it == rearrange_list.end())
-    {
-      rearrange_list.push_back(z_[ii]);
-      z_[ii] = rearrange_list.size() - 1;
-    }
-    else if (it != rearrange_list.end())
-    {
-      int index = it - rearrange_list.begin();
-      z_[ii] = index;
+  /**
+   * This method renumbers the labels in the order of their first occurrence, dropping the vanished components
+   *
+   * @note the statistics, warm starts and sub-clusters of every surviving component follow its label, see
+   * compactLabels()
+   */
+  vector<int> rearrange_list = compactLabels(z_, exec_);
+  K_ = rearrange_list.size();
+  stats_.select(rearrange_list);
+
+  vector<VectorXd> warmDir(rearrange_list.size());
+  for (uint32_t kk=0; kk<rearrange_list.size(); ++kk)
+    if (rearrange_list[kk] < warmDir_.size())
+      warmDir[kk] = std::move(warmDir_[rearrange_list[kk]]);
+  warmDir_ = std::move(warmDir);
+
+  if (subClusters_) {
+    vector<int> subLabels;
+    vector<int> subAge(rearrange_list.size());
+    for (uint32_t kk=0; kk<rearrange_list.size(); ++kk) {
+      subLabels.push_back(2*rearrange_list[kk]);
+      subLabels.push_back(2*rearrange_list[kk]+1);
+      subAge[kk] = subAge_[rearrange_list[kk]];
     }
+    subStats_.select(subLabels);
+    subAge_ = std::move(subAge);
   }
-  K_ = z_.maxCoeff() + 1;
   // logNum_.push_back(K_);
 }
 
 
 template <class dist_t>
-vector<vector<int>> Damm<dist_t>::getIndexLists()
+const Membership & Damm<dist_t>::getIndexLists()
 {
   this ->updateIndexLists();
   return indexLists_;
@@ -332,21 +849,116 @@ vector<vector<int>> Damm<dist_t>::getIndexLists()
 template <class dist_t>
 void Damm<dist_t>::updateIndexLists()
 {
-  vector<vector<int>> indexLists(K_);
-  for (uint32_t ii = 0; ii<N_; ++ii) 
-    indexLists[z_[ii]].push_back(ii); 
-  
-  indexLists_ = indexLists;
+  /**
+   * @note the lists are sorted out of z_ by a parallel counting sort into the reused buffers of indexLists_, see
+   * Membership::build(); when grouping is enabled, the rows are then permuted into the same order, after which
+   * every list is a contiguous range of rows
+   */
+  indexLists_.build(z_, K_, exec_);
+  if (grouped_) {
+    this ->reorderRows(indexLists_.indices());
+    indexLists_.renumber();
+  }
+}
+
+
+template <class dist_t>
+void Damm<dist_t>::reorderRows(const vector<int> &order)
+{
+  /**
+   * This method reorders the rows of x_ and of every array indexed by row, such that row i becomes the former row
+   * order[i]; perm_ follows along, hence keeps the observation held by every row
+   *
+   * @note every array is permuted in place through one scratch column, see permuteRows(), so the grouped layout
+   * keeps no second copy of the data; nothing moves when order is the identity, e.g. once the labels settle
+   */
+  bool identity = true;
+  for (uint32_t ii=0; ii<N_ && identity; ++ii)
+    identity = (order[ii] == int(ii));
+  if (identity)
+    return;
+
+  permuteRows(x_, order, exec_);
+  permuteRows(z_, order, exec_);
+  permuteRows(perm_, order, exec_);
+  if (xf_.size() > 0)
+    permuteRows(xf_, order, exec_);
+  if (zSub_.size() > 0)
+    permuteRows(zSub_, order, exec_);
+
+  if (!indexList_new_.empty()) {
+    vector<int> row(N_);
+    for (uint32_t ii=0; ii<N_; ++ii)
+      row[order[ii]] = ii;
+    for (int &ii : indexList_new_)
+      ii = row[ii];
+    std::sort(indexList_new_.begin(), indexList_new_.end());
+  }
+}
+
+
+template <class dist_t>
+VectorXi Damm<dist_t>::getLabels() const
+{
+  /**
+   * @return the label of every observation, in the order of the input data whatever the layout of the rows
+   */
+  if (perm_.size() == 0)
+    return z_;
+
+  VectorXi z(N_);
+  z(perm_) = z_;
+  return z;
+}
+
+
+template <class dist_t>
+void Damm<dist_t>::setGrouping(bool grouped)
+{
+  /**
+   * This method enables the grouped data layout
+   *
+   * @param grouped when true, the rows of x_ are kept sorted by label by every updateIndexLists(), so that the
+   * directions of a component reach the Karcher mean as a contiguous block instead of a gathered copy; the split/merge
+   * samplers inherit the setting
+   *
+   * @note the row of an observation then changes from one iteration to the next: the label sweep draws from the
+   * stream of the row, and getLabels() maps the labels back to the input order; disabling the layout restores it
+   */
+  if (grouped == grouped_)
+    return;
+
+  if (grouped)
+    perm_ = VectorXi::LinSpaced(N_, 0, N_-1);
+  else {
+    vector<int> order(N_);
+    for (uint32_t ii=0; ii<N_; ++ii)
+      order[perm_[ii]] = ii;
+    this ->reorderRows(order);
+    perm_.resize(0);
+  }
+  grouped_ = grouped;
+  this ->updateIndexLists();
 }
 
 
 template <class dist_t> 
 vector<array<int, 2>>  Damm<dist_t>::computeSimilarity(int mergeNum, int mergeIdx)
 {
+  /**
+   * This method selects merge candidates, i.e. pairs of components
+   *
+   * @param mergeNum the number of pairs returned
+   * @param mergeIdx 0 neighbouring labels from the front, 1 from the back, 2 the closest means, 3 the smallest
+   * KL divergence among the nearest-mean pairs, i.e. not an exact KL ranking of all pairs
+   *
+   * @note the means and covariances come from the sufficient statistics and the means are indexed by a KD-tree; the
+   * mergeNum closest pairs are among the mergeNum nearest neighbours of their members, so querying that many
+   * neighbours per component finds them in O(K log K) instead of scoring all K^2 pairs
+   * @note for 3 the same neighbourhoods are scored by KL divergence, with one Cholesky factorization per component;
+   * a pair of distant means is never scored, even when wide covariances make its KL divergence small
+   */
   // std::cout << "Sim Matrix Idx: " << mergeIdx << std::endl;
-  vector<vector<int>>     indexLists = this-> getIndexLists();
-  vector<MatrixXd>        muLists;
-  vector<MatrixXd>        SigmaLists;
   vector<array<int, 2>>   mergeIndexLists;
 
 
@@ -357,65 +969,82 @@ vector<array<int, 2>>  Damm<dist_t>::computeSimilarity(int mergeNum, int mergeId
   }
   else if (mergeIdx==1){
     for (int ii=0; ii<mergeNum/2; ++ii)
-      mergeIndexLists.push_back({K_-ii-1, K_-ii-2});
+      mergeIndexLists.push_back({int(K_)-ii-1, int(K_)-ii-2});
     return mergeIndexLists;
   }
 
-  for (int kk=0; kk< K_; ++kk)  {
-    MatrixXd x_k = x_(indexLists[kk],  seq(0, (x_.cols()/2)-1));
-    MatrixXd centered = x_k.rowwise() - x_k.colwise().mean();
-    MatrixXd cov = (centered.adjoint() * centered) / double(x_k.rows() - 1);
-    muLists.push_back(x_k.colwise().mean().transpose());
-    SigmaLists.push_back(cov);
-  }
-
-  MatrixXd similarityMatrix = MatrixXd::Constant(mergeNum, mergeNum, numeric_limits<float>::infinity());  
-  for (int ii=0; ii<mergeNum; ++ii)
-      for (int jj=ii+1; jj<mergeNum; ++jj){
-        if (mergeIdx==2)
-          similarityMatrix(ii, jj) = (muLists[ii] - muLists[jj]).norm();
-        else if (mergeIdx==3)
-          similarityMatrix(ii, jj) = this->KL_div(SigmaLists[ii], SigmaLists[jj], muLists[ii], muLists[jj]);
+  const uint32_t K = stats_.size();
+  if (K < 2 || mergeNum < 1)
+    return mergeIndexLists;
+  const uint32_t numNeighbours = std::min<uint32_t>(mergeNum, K-1);
+
+  vector<typename dist_t::dir_t> muLists(K);
+  for (uint32_t kk=0; kk<K; ++kk)
+    muLists[kk] = stats_[kk].mean(stats_.shift());
+
+  KdTree<double, dist_t::dir_t::RowsAtCompileTime> tree;
+  tree.build(muLists);
+
+  vector<LLT<MatrixXd>> cholLists;
+  vector<uint8_t> valid(K, 1);
+  if (mergeIdx==3) {
+    cholLists.resize(K);
+    for (uint32_t kk=0; kk<K; ++kk) {
+      valid[kk] = stats_[kk].count > dim_;
+      if (valid[kk]) {
+        cholLists[kk].compute(stats_[kk].scatter() / double(stats_[kk].count - 1));
+        valid[kk] = (cholLists[kk].info() == Success);
       }
+    }
+  }
 
-  MatrixXd similarityMatrix_flattened;
-  similarityMatrix_flattened = similarityMatrix.transpose(); 
-  similarityMatrix_flattened.resize(1, (similarityMatrix.rows() * similarityMatrix.cols()) );  
-
-
-  for (int ii=0; ii<mergeNum; ++ii){
-    Eigen::MatrixXf::Index minIdx;
-    similarityMatrix_flattened.row(0).minCoeff(&minIdx);
-
-    int merge_i = int(minIdx) / K_;
-    int merge_j = int(minIdx) % K_;
-
-    mergeIndexLists.push_back({merge_i, merge_j});
-    similarityMatrix_flattened(minIdx) = numeric_limits<float>::infinity();
+  // every pair of neighbours once, as (i, j) with i < j
+  vector<array<int, 2>> pairs;
+  for (uint32_t ii=0; ii<K; ++ii)
+    for (const auto &neighbour : tree.nearest(ii, numNeighbours))
+      pairs.push_back({int(std::min(ii, neighbour.second)), int(std::max(ii, neighbour.second))});
+  std::sort(pairs.begin(), pairs.end());
+  pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+  vector<pair<double, array<int, 2>>> candidates;
+  for (const auto &ij : pairs) {
+    if (mergeIdx==2)
+      candidates.push_back({(muLists[ij[0]] - muLists[ij[1]]).norm(), ij});
+    else if (mergeIdx==3 && valid[ij[0]] && valid[ij[1]])
+      candidates.push_back({this->KL_div(cholLists[ij[0]], cholLists[ij[1]], muLists[ij[0]], muLists[ij[1]]), ij});
   }
 
+  std::sort(candidates.begin(), candidates.end());
+  for (uint32_t ii=0; ii<candidates.size() && ii<uint32_t(mergeNum); ++ii)
+    mergeIndexLists.push_back(candidates[ii].second);
 
   return mergeIndexLists;
 }
 
 template <class dist_t> 
-double Damm<dist_t>::KL_div(const MatrixXd& Sigma_p, const MatrixXd& Sigma_q, const MatrixXd& mu_p, const MatrixXd& mu_q)
+double Damm<dist_t>::KL_div(const LLT<MatrixXd>& chol_p, const LLT<MatrixXd>& chol_q, const VectorXd& mu_p, const VectorXd& mu_q)
 {
+  /**
+   * This method evaluates the divergence KL(p||q) of two Gaussians, up to a factor 2, from their Cholesky factors
+   *
+   * @note tr(Sigma_q^{-1} Sigma_p) = ||L_q^{-1} L_p||_F^2, hence no inverse is formed
+   */
   double div = 0;
-  LLT<MatrixXd> lltObjp(Sigma_p);
-  LLT<MatrixXd> lltObjq(Sigma_q);
+  MatrixXd L_p = chol_p.matrixL();
 
-  div += 2*log(lltObjq.matrixL().determinant());
-  div -= 2*log(lltObjp.matrixL().determinant());
-  div -= Sigma_p.cols();
-  div += (lltObjq.matrixL().solve(mu_p-mu_q)).squaredNorm();
-  div += (Sigma_q.inverse() * Sigma_p).trace();
+  div += 2*chol_q.matrixLLT().diagonal().array().log().sum();
+  div -= 2*chol_p.matrixLLT().diagonal().array().log().sum();
+  div -= L_p.cols();
+  div += (chol_q.matrixL().solve(mu_p-mu_q)).squaredNorm();
+  div += (chol_q.matrixL().solve(L_p)).squaredNorm();
 
   return div;
 }
 
 
 template class Damm<NiwDamm<double>>;
+template class Damm<NiwDamm<double, 2>>;
+template class Damm<NiwDamm<double, 3>>;
 
 
 
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <algorithm>
 
 #include <boost/random/uniform_01.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
@@ -11,13 +12,14 @@
 #include "dpmm.hpp"
 #include "niw.hpp"
 #include "niwDamm.hpp"
-#include "kmeans.hpp"
+#include "wishart.hpp"
+#include "relabel.hpp"
 
 
 
 template <class dist_t> 
-Dpmm<dist_t>::Dpmm(const MatrixXd& x, int init_cluster, double alpha, const dist_t& H, const boost::mt19937 &rndGen, int base)
-: alpha_(alpha), H_(H), rndGen_(rndGen), N_(x.rows())
+Dpmm<dist_t>::Dpmm(const MatrixXd& x, int init_cluster, double alpha, const dist_t& H, uint64_t seed, int base)
+: alpha_(alpha), H_(H), seed_(seed), N_(x.rows())
 {
   /**
    * This constructor is only called when sampling using base 1 and 2
@@ -26,7 +28,7 @@ Dpmm<dist_t>::Dpmm(const MatrixXd& x, int init_cluster, double alpha, const dist
    * @param init_cluster is the number of initial clusters, i.e. >= 1
    * @param alpha concentration factor
    * @param H the base distribution
-   * @param rndGen the random number generator
+   * @param seed the key of the Philox streams
    * @param base: 1 pos 2 pos+vel
    * 
    * @note
@@ -47,9 +49,13 @@ Dpmm<dist_t>::Dpmm(const MatrixXd& x, int init_cluster, double alpha, const dist
   if (init_cluster == 1) 
     z_.setZero(N_);
   else if (init_cluster > 1) {
+    const uint32_t stream = stream_++;
     boost::random::uniform_int_distribution<> uni_(0, init_cluster-1);
-    for (int i=0; i<N_; ++i) 
-      z_[i] = uni_(rndGen_); 
+    z_.resize(N_);
+    for (int i=0; i<N_; ++i) {
+      Philox4x32 rndGen(seed_, stream, i);
+      z_[i] = uni_(rndGen); 
+    }
   }
   else { 
     cout<< "Invalid Number of Initial Components" << endl;
@@ -59,73 +65,54 @@ Dpmm<dist_t>::Dpmm(const MatrixXd& x, int init_cluster, double alpha, const dist
 
   K_ = z_.maxCoeff() + 1; 
   this ->updateIndexLists();
+  stats_.build(x_, z_, K_, dim_, false);
 };
 
 
 
 template <class dist_t> 
-Dpmm<dist_t>::Dpmm(const MatrixXd& x, const VectorXi& z, const vector<int> & indexList, const double alpha, const dist_t& H, boost::mt19937 &rndGen)
-: alpha_(alpha), H_(H), rndGen_(rndGen), N_(x.rows()), z_(z), K_(z.maxCoeff()+1), indexList_(indexList)
+Dpmm<dist_t>::Dpmm(const MatrixXd& x, IndexView indexList, const double alpha, const dist_t& H, uint64_t seed,
+  const ExecutionContext &exec, const LaunchOptions &launch)
+: alpha_(alpha), H_(H), seed_(seed), exec_(exec), N_(indexList.size()), K_(2), indexList_(indexList.copy())
 {
   /**
    * This constructor is only called from damm when split/merge
    *
    * @param x is the Data (N, 2M) containing both position and velocity
-   * @param init_cluster is the number of initial clusters, i.e. >= 1
+   * @param indexList the observations of x to be split, e.g. one component or the union of two
    * @param alpha concentration factor
    * @param H the base distribution
-   * @param rndGen the random number generator
-   * @param base: 1 pos 2 pos+vel
+   * @param seed the key of the Philox streams, spawned from the calling sampler
+   * @param exec the threads of the restricted sampler
+   * @param launch the two-means clustering of the observations that the restricted sampler starts from
    * 
-   * @note
+   * @note the positions of indexList are gathered once, so that the sampler holds O(n) rows instead of the whole data:
+   * local row i is observation indexList[i] of x, z_ holds the sub-cluster, 0 or 1, of every local row, and
+   * indexLists_ lists local rows, see globalIndices()
    */
   // Slice the data if containing directional info
   dim_ = x.cols()/2;
-  x_ = x(all, seq(0, dim_-1));
+  x_ = x(indexList, seq(0, dim_-1));
 
 
   //Initialize the data points of given indexList via 2 options
-  vector<int> indexList_i;
-  vector<int> indexList_j;
-  int z_i = z_.maxCoeff() + 1; 
-  int z_j = z_[indexList_[0]];
-
-
   // Option 1: perform kmeans 
   // /*
-  vector<int> kmeans(const MatrixXd& Data, int numClusters);
-  vector<int> z_kmeans = kmeans(x_(indexList, all), 2);
-  for (int ii = 0; ii<indexList_.size(); ++ii)  {
-    if (z_kmeans[ii] == 0) {
-        indexList_i.push_back(indexList_[ii]);
-        z_[indexList_[ii]] = z_i;
-      }
-    else  {
-        indexList_j.push_back(indexList_[ii]);
-        z_[indexList_[ii]] = z_j;
-      }
-  }
+  vector<int> z_kmeans = twoMeans(x_, seed_, stream_++, launch.kmeans, exec_);
+  z_ = Map<VectorXi>(z_kmeans.data(), N_);
   // */
 
 
   // Option 2: randomly assigning them into one of the two clusters
   /*
   boost::random::uniform_int_distribution<> uni_01(0, 1);
-  for (int ii = 0; ii<indexList_.size(); ++ii)  {
-    if (uni_01(rndGen_) == 0) {
-        indexList_i.push_back(indexList_[ii]);
-        z_[indexList_[ii]] = z_i;
-      }
-    else  {
-        indexList_j.push_back(indexList_[ii]);
-        z_[indexList_[ii]] = z_j;
-      }
-  }
+  z_.resize(N_);
+  for (int ii = 0; ii<N_; ++ii)
+    z_[ii] = uni_01(rndGen_);
   */
 
 
-  indexLists_.push_back(indexList_i);
-  indexLists_.push_back(indexList_j);
+  indexLists_.build(z_, K_, exec_);
 };
 
 
@@ -148,16 +135,20 @@ void Dpmm<dist_t>::sampleCoefficientsParameters()
   vector<dist_t> baseDist(K_, H_);
 
   parameters_.resize(K_);
-  components_.resize(K_);
   Pi_.resize(K_);
+  const uint32_t stream = stream_++;
+  vector<Philox4x32> rndGens;
+  rndGens.reserve(K_);
+  for (uint32_t kk=0; kk<K_; ++kk)
+    rndGens.emplace_back(seed_, stream, kk);
 
-  #pragma omp parallel for num_threads(8) 
+  #pragma omp parallel for num_threads(exec_.threadsFor(K_)) schedule(dynamic, 1)
   for (uint32_t kk=0; kk<K_; ++kk)  {
     boost::random::gamma_distribution<> gamma_(indexLists_[kk].size(), 1);
-    Pi_(kk) = gamma_(rndGen_);
-    parameters_[kk] = baseDist[kk].posterior(x_(indexLists_[kk], all));
-    components_[kk] = parameters_[kk].sampleParameter();
+    Pi_(kk) = gamma_(rndGens[kk]);
+    parameters_[kk] = baseDist[kk].posterior(stats_[kk], stats_.shift());
   }
+  sampleParameters(parameters_, rndGens, components_, exec_);
   Pi_ = Pi_ / Pi_.sum();
 }
 
@@ -166,40 +157,58 @@ void Dpmm<dist_t>::sampleCoefficientsParameters()
 template <class dist_t> 
 void Dpmm<dist_t>::sampleLabels()
 {
+  /**
+   * This method samples the labels of all observations block by block through the batched engine
+   * 
+   * @param logLik_i the log mixture likelihood of observation i, i.e. the log-sum-exp of its row of the block, 
+   * reduced over all threads into logLogLik_ when tracking is enabled
+   *
+   * @note stats_ follows the new labels as selected by statsMode_, see StatsMode
+   */
+  engine_.pack(components_, Pi_);
+  const uint32_t blockRows  = exec_.chunkRows(N_, engine_.blockRows());
+  const uint32_t numBlocks  = (N_ + blockRows - 1) / blockRows;
+  const uint32_t stream     = stream_++;
+  const int      numThreads = exec_.threadsFor(numBlocks);
+  const bool     fused      = (statsMode_ == StatsMode::fused);
+  vector<typename dist_t::stats_t> partials(fused ? numThreads : 0, stats_.zeroLike());
+  const VectorXi zOld = fused ? VectorXi() : z_;
+
   double logLik = 0;
   boost::random::uniform_01<> uni_;   
-  #pragma omp parallel for num_threads(8) schedule(dynamic, 300) private(rndGen_)
-  for(uint32_t ii=0; ii<N_; ++ii) { 
-    VectorXd prob(K_);
-
-    double logLik_i = 0;
-    for (uint32_t kk=0; kk<K_; ++kk){
-      double logProb =  components_[kk].logProb(x_(ii, all));
-      prob[kk] = log(Pi_[kk]) + components_[kk].logProb(x_(ii, all));
-      logLik_i += Pi_[kk] * exp(logProb);
+  #pragma omp parallel for num_threads(numThreads) schedule(dynamic, 1) reduction(+:logLik)
+  for (uint32_t bb=0; bb<numBlocks; ++bb) {
+    uint32_t begin = bb * blockRows;
+    uint32_t rows  = std::min(blockRows, N_ - begin);
+
+    MatrixXd logProb(rows, K_);
+    engine_.compute(x_.middleRows(begin, rows), logProb);
+
+    for (uint32_t ii=0; ii<rows; ++ii) {
+      Philox4x32 rndGen(seed_, stream, begin+ii);
+      double logLik_i = 0;
+      z_[begin+ii] = sampleLogProb(logProb.row(ii), uni_(rndGen), trackLogLik_ ? &logLik_i : nullptr);
+      if (fused)
+        partials[omp_get_thread_num()].insert(x_.row(begin+ii), z_[begin+ii]);
+      logLik += logLik_i;
     }
-    logLik += log(logLik_i);
-    double max_prob = prob.maxCoeff();
-    prob = (prob.array() - max_prob).exp() / (prob.array() - max_prob).exp().sum();
-    // prob = (prob.array()-(prob.maxCoeff() + log((prob.array() - prob.maxCoeff()).exp().sum()))).exp().matrix();
-    prob = prob / prob.sum();
-    for (uint32_t kk = 1; kk < prob.size(); ++kk)  
-      prob[kk] = prob[kk-1]+ prob[kk];
+  }
 
-    double uni_draw = uni_(rndGen_);
-    uint32_t kk = 0;
-    while (prob[kk] < uni_draw) 
-      kk++;
-    z_[ii] = kk;
+  if (fused) {
+    dist_t::stats_t::reduce(partials, exec_);
+    stats_ = std::move(partials[0]);
   }
-  logLogLik_.push_back(logLik);
-  logZ_.push_back(z_);
+  else
+    stats_.update(x_, zOld, z_);
+  if (trackLogLik_)
+    logLogLik_.push_back(logLik);
+  // logZ_.push_back(z_);
 }
 
 
 
 template <class dist_t> 
-void Dpmm<dist_t>::sampleCoefficientsParameters(const vector<int> &indexList)
+void Dpmm<dist_t>::sampleCoefficientsParameters_restricted()
 {
   /**
    * This method samples coefficients and parameters together in a split/merge scenario
@@ -210,6 +219,8 @@ void Dpmm<dist_t>::sampleCoefficientsParameters(const vector<int> &indexList)
    * 
    * @note might be possible to integrate with the original member, but easier to maintain as a standalone method
    * 
+   * @note when grouping is enabled, the posteriors come from stats_, which sampleLabels_restricted() keeps in step
+   * with the sub-clusters, so that no scan gathers their rows
    */
 
   vector<dist_t> baseDist(2, H_);
@@ -217,65 +228,132 @@ void Dpmm<dist_t>::sampleCoefficientsParameters(const vector<int> &indexList)
   parameters_.resize(2);
   components_.resize(2);
   Pi_.resize(2);
+  const uint32_t stream = stream_++;
 
-  #pragma omp parallel for num_threads(8) 
+  #pragma omp parallel for num_threads(exec_.threadsFor(2))
   for (uint32_t kk=0; kk<2; ++kk)  {
+    Philox4x32 rndGen(seed_, stream, kk);
     boost::random::gamma_distribution<> gamma_(indexLists_[kk].size(), 1);
-    Pi_(kk) = gamma_(rndGen_);
-    parameters_[kk] = baseDist[kk].posterior(x_(indexLists_[kk], all));
-    components_[kk] = parameters_[kk].sampleParameter();
+    Pi_(kk) = gamma_(rndGen);
+    if (grouped_)
+      parameters_[kk] = baseDist[kk].posterior(stats_[kk], stats_.shift());
+    else
+      parameters_[kk] = baseDist[kk].posterior(x_(indexLists_[kk], all));
+    components_[kk] = parameters_[kk].sampleParameter(rndGen);
   }
   Pi_ = Pi_ / Pi_.sum();
 }
 
 
 template <class dist_t> 
-void Dpmm<dist_t>::sampleLabels(const vector<int> &indexList)
+uint32_t Dpmm<dist_t>::sampleLabels_restricted()
 {
    /**
    * This method samples labels in split merge scenario
    * 
-   * @note hard to work around appending the indices to indexList_i/j, had to add omp critical to avoid value race condition
+   * @return the number of observations that changed sub-cluster, as recorded in z_
+   *
+   * @note every thread samples a static range of the local rows into z_, counts its observations that go to the
+   * first sub-cluster, and after an exclusive scan of these counts over the threads, copies its range into both
+   * slices of indexLists_ at the offsets reserved for it; no critical section is involved and both lists stay
+   * ascending, whatever the number of threads
+   * @note every draw is keyed by the observation of the calling sampler, not by the local row
+   * @note when grouping is enabled, the moves are then applied to stats_ in row order, see StatsStore::update()
+   * @note the buffers are reused from one scan to the next
    */
+  const uint32_t N = N_;
+  const uint32_t stream = stream_++;
+  const int maxThreads  = exec_.threadsFor(N, 1024);
+  const VectorXi zOld   = grouped_ ? z_ : VectorXi();
 
-  indexLists_.clear();
-  vector<int> indexList_i;
-  vector<int> indexList_j;
+  threadCounts_.assign(maxThreads + 1, 0);
 
-  boost::random::uniform_01<> uni_;    
-  #pragma omp parallel for num_threads(4) schedule(static) private(rndGen_)    
-  for(uint32_t ii=0; ii<indexList.size(); ++ii) {
-    vector<int> indexVector;
-    VectorXd prob(2);
-    for (uint32_t kk=0; kk<2; ++kk)
-      prob[kk] = log(Pi_[kk]) + components_[kk].logProb(x_(indexList[ii], all)); 
+  uint32_t numMoved = 0;
+  #pragma omp parallel num_threads(maxThreads) reduction(+:numMoved)
+  {
+    const int numThreads = omp_get_num_threads();
+    const int tid        = omp_get_thread_num();
+    const uint32_t chunk = (N + numThreads - 1) / numThreads;
+    const uint32_t begin = std::min<uint64_t>(N, uint64_t(tid) * chunk);
+    const uint32_t end   = std::min<uint64_t>(N, uint64_t(begin) + chunk);
+
+    boost::random::uniform_01<> uni_;    
+    uint32_t numFirst = 0;
+    for (uint32_t ii=begin; ii<end; ++ii) {
+      double logRatio = log(Pi_[1]) + components_[1].logProb(x_.row(ii).transpose())
+        - log(Pi_[0]) - components_[0].logProb(x_.row(ii).transpose());
+
+      Philox4x32 rndGen(seed_, stream, indexList_[ii]);
+      bool toFirst = uni_(rndGen) * (1 + exp(logRatio)) < 1;
+
+      int label = toFirst ? 0 : 1;
+      numMoved += (z_[ii] != label);
+      z_[ii] = label;
+      numFirst += toFirst;
+    }
+    threadCounts_[tid+1] = numFirst;
 
-    double max_prob = prob.maxCoeff();
-    prob = (prob.array() - max_prob).exp() / (prob.array() - max_prob).exp().sum();
-    // prob = (prob.array()-(prob.maxCoeff() + log((prob.array() - prob.maxCoeff()).exp().sum()))).exp().matrix();
-    prob = prob / prob.sum();
-    
-    #pragma omp critical
+    #pragma omp barrier
+    #pragma omp single
     {
-      if (uni_(rndGen_) < prob[0])
-        indexList_i.push_back(indexList[ii]);
+      for (int tt=0; tt<numThreads; ++tt)
+        threadCounts_[tt+1] += threadCounts_[tt];
+      const uint32_t counts[2] = {threadCounts_[numThreads], N - threadCounts_[numThreads]};
+      indexLists_.reset(counts, 2);
+    }
+
+    int *list_i = indexLists_.slot(0) + threadCounts_[tid];
+    int *list_j = indexLists_.slot(1) + begin - threadCounts_[tid];
+    for (uint32_t ii=begin; ii<end; ++ii) {
+      if (z_[ii] == 0)
+        *list_i++ = ii;
       else
-        indexList_j.push_back(indexList[ii]);
+        *list_j++ = ii;
     }
   }
 
-  indexLists_.push_back(indexList_i);
-  indexLists_.push_back(indexList_j);
+  if (grouped_)
+    stats_.update(x_, zOld, z_);
+  return numMoved;
+}
+
+
+template <class dist_t> 
+uint32_t Dpmm<dist_t>::launch(const LaunchOptions &opt)
+{
+  /**
+   * This method runs the intermediate restricted Gibbs scans of a split/merge proposal until the two sub-clusters
+   * settle
+   *
+   * @return the number of scans performed
+   *
+   * @note the scans stop early once one sub-cluster vanishes, which the caller checks through indexLists_
+   */
+  const double maxMoved = opt.tolerance * N_;
+
+  uint32_t tt = 0;
+  while (tt < opt.maxScans) {
+    this ->sampleCoefficientsParameters_restricted();
+    uint32_t numMoved = this ->sampleLabels_restricted();
+    ++tt;
+    if (indexLists_[0].empty() || indexLists_[1].empty())
+      break;
+    if (tt >= opt.minScans && numMoved <= maxMoved)
+      break;
+  }
+  return tt;
 }
 
 
 
 template <class dist_t> 
-double Dpmm<dist_t>::logProposalRatio(const vector<int> &indexList_i, const vector<int> &indexList_j)
+double Dpmm<dist_t>::logProposalRatio(IndexView indexList_i, IndexView indexList_j)
 {
   /**
    * This method computes the proposal probability of the last Gibbs scan
    * 
+   * @param indexList_i, indexList_j local rows of the two sub-clusters
+   * 
    * @note the proposal probability in Gibbs sampling is implicitly defined to be the product of conditional probability;
    * the components_ are the last drawn Gauss distribution to sample the labels of observations; hence the last Gibbs scan
    * from the launch state to the proposed split state in split, or the original split state in merge
@@ -302,12 +380,13 @@ double Dpmm<dist_t>::logProposalRatio(const vector<int> &indexList_i, const vect
 
 
 template <class dist_t>
-double Dpmm<dist_t>::logTargetRatio(const vector<int>  &indexList_i, const vector<int> &indexList_j)
+double Dpmm<dist_t>::logTargetRatio(IndexView indexList_i, IndexView indexList_j)
 {
   /**
    * This method computes the target probability of the proposed state
    *
-   * @param parameter_ij associated with @param indexList_ given during initialization
+   * @param indexList_i, indexList_j local rows of the two sub-clusters
+   * @param parameter_ij associated with all the local rows, i.e. @param indexList_ given during initialization
    * 
    * @note the target ratio is the posterior probability of assignment after observing data;
    * the marginal distribution of all the observations are cancelled out in ratio;
@@ -319,21 +398,31 @@ double Dpmm<dist_t>::logTargetRatio(const vector<int>  &indexList_i, const vecto
    */
 
   VectorXd Pi(2);
+  Philox4x32 rndGen(seed_, stream_++, 0);
   boost::random::gamma_distribution<> gamma_i(indexList_i.size(), 1);
   boost::random::gamma_distribution<> gamma_j(indexList_j.size(), 1);
 
-  Pi(0) = gamma_i(rndGen_);
-  Pi(1) = gamma_j(rndGen_);
+  Pi(0) = gamma_i(rndGen);
+  Pi(1) = gamma_j(rndGen);
   Pi = Pi / Pi.sum();
 
 
-  Niw<double> parameter_ij = H_.posterior(x_(indexList_, all));
-  Niw<double> parameter_i  = H_.posterior(x_(indexList_i, all));
-  Niw<double> parameter_j  = H_.posterior(x_(indexList_j, all));
+  dist_t parameter_ij, parameter_i, parameter_j;
+  if (grouped_) {
+    groups_.build(x_, {indexList_i, indexList_j});
+    parameter_ij = H_.posterior(groups_.data());
+    parameter_i  = H_.posterior(groups_.block(0));
+    parameter_j  = H_.posterior(groups_.block(1));
+  }
+  else {
+    parameter_ij = H_.posterior(x_);
+    parameter_i  = H_.posterior(x_(indexList_i, all));
+    parameter_j  = H_.posterior(x_(indexList_j, all));
+  }
 
-  Gauss<double> component_ij = parameter_ij.sampleParameter();
-  Gauss<double> component_i  = parameter_i.sampleParameter();
-  Gauss<double> component_j  = parameter_j.sampleParameter();
+  typename dist_t::component_t component_ij = parameter_ij.sampleParameter(rndGen);
+  typename dist_t::component_t component_i  = parameter_i.sampleParameter(rndGen);
+  typename dist_t::component_t component_j  = parameter_j.sampleParameter(rndGen);
   
   double logTargetRatio = 0;
 
@@ -358,45 +447,53 @@ double Dpmm<dist_t>::logTargetRatio(const vector<int>  &indexList_i, const vecto
 
 
 template <class dist_t>
-void Dpmm<dist_t>::reorderAssignments()
-{ 
+void Dpmm<dist_t>::setGrouping(bool grouped)
+{
   /**
-   * This method rearranges and reassigns the labels, taking care of the situation when one group vanishes after sampling
+   * This method selects how the restricted sampler reaches the posteriors of its two sub-clusters
    *
-   * @param rearrangeList contains the labels before rearranging
-   * 
-   * @note rearrangeList.end() does not point to the last element, but rather to an imaginary element just beyond the last
-   * 
-   * @note Initialize the rearrange the list by appending the label of the first observation
+   * @param grouped when true, the statistics of both sub-clusters are built here once and then follow the moves of
+   * every restricted scan; otherwise every scan gathers the rows of both sub-clusters
    */
+  grouped_ = grouped;
+  if (grouped_ && !indexList_.empty())
+    stats_.build(x_, z_, K_, dim_, false);
+}
 
 
+template <class dist_t>
+vector<int> Dpmm<dist_t>::globalIndices(IndexView indexList) const
+{
+  /**
+   * This method maps local rows of the restricted sampler back to the observations of the calling sampler, e.g. to
+   * commit an accepted split
+   */
+  vector<int> global(indexList.size());
+  for (uint32_t ii=0; ii<indexList.size(); ++ii)
+    global[ii] = indexList_[indexList[ii]];
+  return global;
+}
 
-  vector<uint8_t> rearrangeList;
-  rearrangeList.push_back(z_[0]);
 
-  for (uint32_t ii=1; ii<N_; ++ii) {
-    vector<uint8_t>::iterator it;
-    it = find (rearrangeList.begin(), rearrangeList.end(), z_[ii]);
-    
-    if (it == rearrangeList.end()) {
-      rearrangeList.push_back(z_[ii]);
-      z_[ii] = rearrangeList.size() - 1;
-    }
-    
-    else if (it != rearrangeList.end()) {
-      z_[ii] = it - rearrangeList.begin();
-    }
-  }
-
-  K_ = z_.maxCoeff() + 1;
+template <class dist_t>
+void Dpmm<dist_t>::reorderAssignments()
+{ 
+  /**
+   * This method rearranges and reassigns the labels, taking care of the situation when one group vanishes after sampling
+   *
+   * @note the labels are renumbered in the order of their first occurrence, for any number of components, see
+   * compactLabels()
+   */
+  vector<int> rearrangeList = compactLabels(z_, exec_);
+  K_ = rearrangeList.size();
+  stats_.select(rearrangeList);
   logNum_.push_back(K_);
 }
 
 
 
 template <class dist_t>
-vector<vector<int>> Dpmm<dist_t>::getIndexLists()
+const Membership & Dpmm<dist_t>::getIndexLists()
 {
   this ->updateIndexLists();
   return indexLists_;
@@ -410,20 +507,18 @@ void Dpmm<dist_t>::updateIndexLists()
    * This method updates the class member indexLists_, of which every entry contains the indices of observations belonging to
    * the same group
    * 
-   * @param indexLists an empty vector of size K awaits to be populated by the indices of every group
-   * 
-   * @note might be avtangeous to directly modify indexLists_, rather than declaring and moving a new vector? Not 
-   * a significant consideration nevertheless
+   * @note the lists are sorted out of z_ by a parallel counting sort into the reused buffers of indexLists_, see
+   * Membership::build()
    */
-
-  vector<vector<int>> indexLists(K_);
-  for (uint32_t ii = 0; ii<N_; ++ii)  
-    indexLists[z_[ii]].push_back(ii); 
-  indexLists_ = std::move(indexLists);
+  indexLists_.build(z_, K_, exec_);
 }
 
 
 template class Dpmm<Niw<double>>;
+template class Dpmm<Niw<double, 2>>;
+template class Dpmm<Niw<double, 3>>;
+template class Dpmm<Niw<double, 4>>;
+template class Dpmm<Niw<double, 6>>;
 
 
 
@@ -660,12 +755,12 @@ int Dpmm<dist_t>::sampleLabelsCollapsed()
 {
   if (indexLists_[0].size()==1) {
     z_[indexLists_[0][0]] =  z_[indexLists_[1][0]];
-    logZ_.push_back(z_);
+    // logZ_.push_back(z_);
     return 1;
   }
   else if (indexLists_[1].size()==1){
     z_[indexLists_[1][0]] =  z_[indexLists_[0][0]];
-    logZ_.push_back(z_);
+    // logZ_.push_back(z_);
     return 1;
   }
 
@@ -725,7 +820,7 @@ int Dpmm<dist_t>::sampleLabelsCollapsed()
   indexLists_.clear();
   indexLists_.push_back(indexList_i);
   indexLists_.push_back(indexList_j);
-  logZ_.push_back(z_);
+  // logZ_.push_back(z_);
   return 0;
 }
 
@@ -753,7 +848,7 @@ void Dpmm<dist_t>::sampleLabelsCollapsedParallel()
       kk++;
     z_[ii] = kk;
   }
-  logZ_.push_back(z_);
+  // logZ_.push_back(z_);
 }
 
 
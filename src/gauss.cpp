@@ -3,37 +3,69 @@
 #define PI 3.141592653589793
 
 
-template<class T>
-Gauss<T>::Gauss(const Matrix<T,Dynamic,1> &mu, const Matrix<T,Dynamic,Dynamic> &sigma, boost::mt19937 &rndGen)
-:mu_(mu), sigma_(sigma), dim_(mu.size()), rndGen_(rndGen) 
+template<class T, int dim>
+Gauss<T, dim>::Gauss(const Matrix<T,dim,1> &mu, const Matrix<T,dim,dim> &sigma)
+:mu_(mu), sigma_(sigma), dim_(mu.size()) 
 {
+  /**
+   * Factorize the covariance once; every logProb call afterwards reuses the inverse Cholesky factor
+   * and the log-normalizer
+   */
   assert(sigma_.rows()==mu_.size()); 
   assert(sigma_.cols()==mu_.size());
+
+  LLT<Matrix<T,dim,dim>> lltObj(sigma_);
+  invChol_ = lltObj.matrixL().solve(Matrix<T,dim,dim>::Identity(dim_, dim_));
+  logNorm_ = -0.5 * (dim_ * log(2*PI) + 2 * lltObj.matrixLLT().diagonal().array().log().sum());
 };
 
 
 
-template<class T>
-T Gauss<T>::logProb(const Matrix<T,Dynamic,1> &x_i)
+template<class T, int dim>
+Gauss<T, dim>::Gauss(const Matrix<T,dim,1> &mu, const Matrix<T,dim,dim> &chol, const Matrix<T,dim,dim> &invChol)
+:mu_(mu), dim_(mu.size()), invChol_(invChol)
+{
+  /**
+   * This constructor takes the factorization sigma_ = chol chol^T as drawn by sampleInvWishartChol, so nothing is
+   * factorized here
+   *
+   * @param invChol chol^{-1}, lower triangular
+   */
+  sigma_   = chol.template triangularView<Lower>() * chol.transpose();
+  logNorm_ = -0.5 * (dim_ * log(2*PI) + 2 * chol.diagonal().array().log().sum());
+};
+
+
+
+template<class T, int dim>
+T Gauss<T, dim>::logProb(const Matrix<T,dim,1> &x_i) const
 { 
-  LLT<Matrix<T,Dynamic,Dynamic>> lltObj(sigma_);
-  T logProb =  dim_ * log(2*PI);
-  if (sigma_.rows()==2)
-    logProb += log(sigma_(0, 0) * sigma_(1, 1) - sigma_(0, 1) * sigma_(1, 0));
-  else
-    logProb += 2 * log(lltObj.matrixL().determinant());
-  logProb += (lltObj.matrixL().solve(x_i-mu_)).squaredNorm();
-
-  return -0.5 * logProb;
+  /**
+   * @note the whitened residual L^{-1}(x_i-mu_) is accumulated row by row over the lower triangle,
+   * which needs no temporaries
+   */
+  T mahal = 0;
+  for (uint32_t r=0; r<dim_; ++r) {
+    T w = 0;
+    for (uint32_t c=0; c<=r; ++c)
+      w += invChol_(r, c) * (x_i[c] - mu_[c]);
+    mahal += w * w;
+  }
+
+  return logNorm_ - 0.5 * mahal;
 };
 
 
-template<class T>
-T Gauss<T>::prob(const Matrix<T,Dynamic,1> &x_i)
+template<class T, int dim>
+T Gauss<T, dim>::prob(const Matrix<T,dim,1> &x_i) const
 { 
   T logProb = this ->logProb(x_i);
   return exp(logProb);
 };
 
 
-template class Gauss<double>;
\ No newline at end of file
+template class Gauss<double>;
+template class Gauss<double, 2>;
+template class Gauss<double, 3>;
+template class Gauss<double, 4>;
+template class Gauss<double, 6>;
@@ -5,38 +5,84 @@
 #define PI 3.141592653589793
 
 
-template<class T>
-gaussDamm<T>::gaussDamm(const Matrix<T,Dynamic,1> &meanPos, const Matrix<T,Dynamic, Dynamic> &covPos,
-const Matrix<T,Dynamic,1> &meanDir, T covDir, boost::mt19937 &rndGen) 
-:meanPos_(meanPos), covPos_(covPos), meanDir_(meanDir), covDir_(covDir), rndGen_(rndGen)
+template<class T, int dim>
+gaussDamm<T, dim>::gaussDamm(const Matrix<T,dim,1> &meanPos, const Matrix<T,dim, dim> &covPos,
+const Matrix<T,dim,1> &meanDir, T covDir) 
+:meanPos_(meanPos), covPos_(covPos), meanDir_(meanDir), covDir_(covDir)
 {
+  /**
+   * The packed covariance covHat = diag(covPos, covDir) is factorized once here, so that logProb
+   * only performs a triangular solve against the cached inverse factor
+   */
   dim_ = meanPos.rows();
   meanHat_.setZero(dim_+1);
-  meanHat_(seq(0,dim_-1)) = meanPos_;
+  meanHat_.head(dim_) = meanPos_;
 
-  covHat_.setZero(dim_+1, dim_+1);
-  covHat_(seq(0,dim_-1), seq(0,dim_-1)) = covPos_;
-  covHat_(dim_, dim_) = covDir_;
+  Matrix<T,dimHat,dimHat> covHat;
+  covHat.setZero(dim_+1, dim_+1);
+  covHat.topLeftCorner(dim_, dim_) = covPos_;
+  covHat(dim_, dim_) = covDir_;
+
+  LLT<Matrix<T,dimHat,dimHat>> lltObj(covHat);
+  invCholHat_ = lltObj.matrixL().solve(Matrix<T,dimHat,dimHat>::Identity(dim_+1, dim_+1));
+  logNorm_ = -0.5 * (dim_ * log(2*PI) + 2 * lltObj.matrixLLT().diagonal().array().log().sum());
+};
+
+
+
+template<class T, int dim>
+gaussDamm<T, dim>::gaussDamm(const Matrix<T,dim,1> &meanPos, const Matrix<T,dim, dim> &cholPos, 
+const Matrix<T,dim, dim> &invCholPos, const Matrix<T,dim,1> &meanDir, T covDir) 
+:meanPos_(meanPos), meanDir_(meanDir), covDir_(covDir)
+{
+  /**
+   * This constructor takes the factorization covPos = cholPos cholPos^T as drawn by sampleInvWishartChol; the packed
+   * covariance is block diagonal, so its inverse factor is assembled without any factorization
+   *
+   * @param invCholPos cholPos^{-1}, lower triangular
+   */
+  dim_ = meanPos.rows();
+  covPos_ = cholPos.template triangularView<Lower>() * cholPos.transpose();
+
+  meanHat_.setZero(dim_+1);
+  meanHat_.head(dim_) = meanPos_;
+
+  invCholHat_.setZero(dim_+1, dim_+1);
+  invCholHat_.topLeftCorner(dim_, dim_) = invCholPos;
+  invCholHat_(dim_, dim_) = 1 / std::sqrt(covDir_);
+  logNorm_ = -0.5 * (dim_ * log(2*PI) + 2 * cholPos.diagonal().array().log().sum() + log(covDir_));
 };
 
 
 
-template<class T>
-T gaussDamm<T>::logProb(const Matrix<T,Dynamic,1> &x_i)
+template<class T, int dim>
+T gaussDamm<T, dim>::logProb(const Matrix<T,dimFull,1> &x_i) const
 { 
-  Matrix<T,Dynamic,1> xDir_i = x_i(seq(dim_, last));
-  Matrix<T,Dynamic,1> xHat(dim_+1);
-  xHat(seq(0, dim_-1)) = x_i(seq(0, dim_-1));
-  xHat(dim_) = (rie_log(meanDir_, xDir_i)).norm();
+  /**
+   * @param angle the geodesic distance between the directional part of x_i and meanDir_; i.e. the norm of 
+   * rie_log(meanDir_, xDir_i), which is the last coordinate of xHat
+   * 
+   * @note the whitened residual L^{-1}(xHat-meanHat_) is accumulated row by row over the lower triangle,
+   * which needs no temporaries
+   */
+  T dot = 0, normMean = 0, normDir = 0;
+  for (uint32_t i=0; i<dim_; ++i) {
+    dot      += meanDir_[i] * x_i[dim_+i];
+    normMean += meanDir_[i] * meanDir_[i];
+    normDir  += x_i[dim_+i] * x_i[dim_+i];
+  }
+  T angle = std::acos(std::min(std::max(dot / std::sqrt(normMean * normDir), T(-1)), T(1)));
   
-  // xHat(dim_) = unsigned_angle(xDir, meanDir_);
-  // xHat(dim_) = 0;
-
-  LLT<Matrix<T,Dynamic,Dynamic>> lltObj(covHat_);
-  T logProb =  dim_ * log(2*PI);
-  logProb += 2 * log(lltObj.matrixL().determinant());
-  logProb += (lltObj.matrixL().solve(xHat-meanHat_)).squaredNorm();
-  return -0.5 * logProb;
+  T mahal = 0;
+  for (uint32_t r=0; r<=dim_; ++r) {
+    T w = 0;
+    for (uint32_t c=0; c<r && c<dim_; ++c)
+      w += invCholHat_(r, c) * (x_i[c] - meanHat_[c]);
+    w += invCholHat_(r, r) * ((r<dim_ ? x_i[r] : angle) - meanHat_[r]);
+    mahal += w * w;
+  }
+
+  return logNorm_ - 0.5 * mahal;
 }
 
 
@@ -92,4 +138,10 @@ T gaussDamm<T>::logProb(const Matrix<T,Dynamic,1> &x_i)
 // };
 
 
-template class gaussDamm<double>;
\ No newline at end of file
+template class gaussDamm<double>;
+template class gaussDamm<double, 2>;
+template class gaussDamm<double, 3>;
+
+template class gaussDamm<float>;
+template class gaussDamm<float, 2>;
+template class gaussDamm<float, 3>;
\ No newline at end of file
@@ -0,0 +1,79 @@
+#include <algorithm>
+#include "labelGroups.hpp"
+
+
+
+template<typename T>
+void LabelGroups<T>::build(const Matrix<T,Dynamic,Dynamic> &x, const VectorXi &z, uint32_t K, const ExecutionContext &exec)
+{
+  /**
+   * This method sorts the observations by label with a parallel counting sort, see Membership::build()
+   *
+   * @param z labels in [0, K), e.g. right after reorderAssignments()
+   */
+  owned_.build(z, K, exec);
+  shared_ = nullptr;
+  this ->gather(x, exec);
+}
+
+
+
+template<typename T>
+void LabelGroups<T>::build(const Matrix<T,Dynamic,Dynamic> &x, const Membership &members, const ExecutionContext &exec)
+{
+  /**
+   * This method groups the observations by an already sorted membership, e.g. that of the sampler, which is
+   * referenced rather than copied
+   */
+  shared_ = &members;
+  this ->gather(x, exec);
+}
+
+
+
+template<typename T>
+void LabelGroups<T>::build(const Matrix<T,Dynamic,Dynamic> &x, const std::vector<IndexView> &indexLists)
+{
+  /**
+   * This method groups the rows of given index lists, e.g. the two sub-clusters of a split/merge proposal, of which
+   * the members are already known
+   */
+  owned_.build(indexLists);
+  shared_ = nullptr;
+  this ->gather(x, ExecutionContext(1));
+}
+
+
+
+template<typename T>
+void LabelGroups<T>::gather(const Matrix<T,Dynamic,Dynamic> &x, const ExecutionContext &exec)
+{
+  /**
+   * This method copies the rows of x in the order of members()
+   *
+   * @note the rows are copied column by column, as both x and data_ are column-major; every thread owns one static
+   * range of rows
+   */
+  const std::vector<int> &perm = this ->members().indices();
+  const uint32_t N    = perm.size();
+  const uint32_t cols = x.cols();
+
+  data_.resize(N, cols);
+  #pragma omp parallel num_threads(exec.threadsFor(N, 4096))
+  {
+    const int numThreads = omp_get_num_threads();
+    const int tid        = omp_get_thread_num();
+    const uint32_t chunk = (N + numThreads - 1) / numThreads;
+    const uint32_t begin = std::min<uint64_t>(N, uint64_t(tid) * chunk);
+    const uint32_t end   = std::min<uint64_t>(N, uint64_t(begin) + chunk);
+
+    for (uint32_t cc=0; cc<cols; ++cc)
+      for (uint32_t ii=begin; ii<end; ++ii)
+        data_(ii, cc) = x(perm[ii], cc);
+  }
+}
+
+
+
+
+template class LabelGroups<double>;
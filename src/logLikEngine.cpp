@@ -0,0 +1,137 @@
+#include <cmath>
+#include <algorithm>
+
+#include "logLikEngine.hpp"
+#include "riem.hpp"
+
+
+
+template<typename T>
+template<int dim>
+void LogLikEngine<T>::pack(const std::vector<gaussDamm<T,dim>> &components, const VectorXd &Pi)
+{
+  /**
+   * This method packs the cached factorizations of every gaussDamm component into stacked matrices
+   *
+   * @note covHat of gaussDamm is block diagonal, hence L^{-1} is block diagonal as well: the top-left block
+   * whitens the position and the last diagonal entry is 1/sqrt(covDir)
+   */
+  K_      = components.size();
+  dimPos_ = components[0].getDim();
+  dimDir_ = dimPos_;
+
+  whiten_.resize(dimPos_, K_*dimPos_);
+  offset_.resize(K_*dimPos_);
+  meanDir_.resize(dimDir_, K_);
+  precDir_.resize(K_);
+  logWeight_.resize(K_);
+
+  for (uint32_t kk=0; kk<K_; ++kk) {
+    const gaussDamm<T,dim> &comp = components[kk];
+    whiten_.middleCols(kk*dimPos_, dimPos_) = comp.invCholHat().topLeftCorner(dimPos_, dimPos_).transpose();
+    offset_.segment(kk*dimPos_, dimPos_) = comp.meanHat().head(dimPos_).transpose() * whiten_.middleCols(kk*dimPos_, dimPos_);
+    meanDir_.col(kk) = comp.meanDir().normalized();
+    precDir_(kk) = comp.invCholHat()(dimPos_, dimPos_) * comp.invCholHat()(dimPos_, dimPos_);
+    logWeight_(kk) = log(Pi[kk]) + comp.logNorm();
+  }
+
+  blockRows_ = std::min(std::max(32768 / (K_*(dimPos_+1)), 32u), 1024u);
+}
+
+
+
+template<typename T>
+template<int dim>
+void LogLikEngine<T>::pack(const std::vector<Gauss<T,dim>> &components, const VectorXd &Pi)
+{
+  K_      = components.size();
+  dimPos_ = components[0].getDim();
+  dimDir_ = 0;
+
+  whiten_.resize(dimPos_, K_*dimPos_);
+  offset_.resize(K_*dimPos_);
+  meanDir_.resize(0, K_);
+  precDir_.resize(0);
+  logWeight_.resize(K_);
+
+  for (uint32_t kk=0; kk<K_; ++kk) {
+    const Gauss<T,dim> &comp = components[kk];
+    whiten_.middleCols(kk*dimPos_, dimPos_) = comp.invChol().transpose();
+    offset_.segment(kk*dimPos_, dimPos_) = comp.mu().transpose() * whiten_.middleCols(kk*dimPos_, dimPos_);
+    logWeight_(kk) = log(Pi[kk]) + comp.logNorm();
+  }
+
+  blockRows_ = std::min(std::max(32768 / (K_*(dimPos_+1)), 32u), 1024u);
+}
+
+
+
+template<typename T>
+void LogLikEngine<T>::compute(const Ref<const Matrix<T,Dynamic,Dynamic>> &x, Ref<Matrix<T,Dynamic,Dynamic>> logLik) const
+{
+  /**
+   * This method fills logLik (n, K) for a block of n observations
+   *
+   * @param x (n, dimPos_+dimDir_) containing the position followed by the direction of every observation
+   *
+   * @note the whitened residuals of all K components come out of a single (n, dimPos_) x (dimPos_, K*dimPos_)
+   * product, so the cost is dominated by GEMM; keep n around blockRows_ so that the product stays in cache
+   */
+  Matrix<T,Dynamic,Dynamic> whitened = x.leftCols(dimPos_) * whiten_;
+  whitened.rowwise() -= offset_;
+
+  for (uint32_t kk=0; kk<K_; ++kk)
+    logLik.col(kk) = whitened.middleCols(kk*dimPos_, dimPos_).rowwise().squaredNorm();
+
+  if (dimDir_ > 0) {
+    Matrix<T,Dynamic,1> invNorm = x.rightCols(dimDir_).rowwise().norm().cwiseInverse();
+    Matrix<T,Dynamic,Dynamic> angle = x.rightCols(dimDir_) * meanDir_;
+    angle = angle.array().colwise() * invNorm.array();
+    rie_acos(angle.data(), angle.size());
+    logLik.array() += angle.array().square().rowwise() * precDir_.array();
+  }
+
+  logLik = (logLik.array() * T(-0.5)).rowwise() + logWeight_.array();
+}
+
+
+
+template<typename T>
+void LogLikEngine<T>::computeAll(const Matrix<T,Dynamic,Dynamic> &x, Matrix<T,Dynamic,Dynamic> &logLik, const ExecutionContext &exec) const
+{
+  /**
+   * This method fills the whole (N, K) matrix in one call, block by block
+   */
+  const uint32_t N = x.rows();
+  const uint32_t blockRows = exec.chunkRows(N, blockRows_);
+  const uint32_t numBlocks = (N + blockRows - 1) / blockRows;
+  logLik.resize(N, K_);
+
+  #pragma omp parallel for num_threads(exec.threadsFor(numBlocks)) schedule(dynamic, 1)
+  for (uint32_t bb=0; bb<numBlocks; ++bb) {
+    uint32_t begin = bb * blockRows;
+    uint32_t rows  = std::min(blockRows, N - begin);
+    compute(x.middleRows(begin, rows), logLik.middleRows(begin, rows));
+  }
+}
+
+
+
+template class LogLikEngine<double>;
+
+template void LogLikEngine<double>::pack(const std::vector<gaussDamm<double>> &, const VectorXd &);
+template void LogLikEngine<double>::pack(const std::vector<gaussDamm<double, 2>> &, const VectorXd &);
+template void LogLikEngine<double>::pack(const std::vector<gaussDamm<double, 3>> &, const VectorXd &);
+
+template void LogLikEngine<double>::pack(const std::vector<Gauss<double>> &, const VectorXd &);
+template void LogLikEngine<double>::pack(const std::vector<Gauss<double, 2>> &, const VectorXd &);
+template void LogLikEngine<double>::pack(const std::vector<Gauss<double, 3>> &, const VectorXd &);
+template void LogLikEngine<double>::pack(const std::vector<Gauss<double, 4>> &, const VectorXd &);
+template void LogLikEngine<double>::pack(const std::vector<Gauss<double, 6>> &, const VectorXd &);
+
+
+template class LogLikEngine<float>;
+
+template void LogLikEngine<float>::pack(const std::vector<gaussDamm<float>> &, const VectorXd &);
+template void LogLikEngine<float>::pack(const std::vector<gaussDamm<float, 2>> &, const VectorXd &);
+template void LogLikEngine<float>::pack(const std::vector<gaussDamm<float, 3>> &, const VectorXd &);
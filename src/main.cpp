@@ -1,10 +1,10 @@
 #include <iostream>
 #include <fstream>
 #include <limits>
+#include <chrono>
 #include <filesystem>
 
 #include <Eigen/Dense>
-#include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
 #include <boost/program_options.hpp>
 
@@ -12,22 +12,177 @@
 #include "niwDamm.hpp"
 #include "dpmm.hpp"
 #include "damm.hpp"
+#include "moveScheduler.hpp"
+#include "execution.hpp"
 
 
 namespace po = boost::program_options;
 
 
+
+struct RunOptions
+{
+    /**
+     * Run-wide settings handed to the sampler helpers below, on top of the model hyperparameters
+     */
+    uint64_t seed;
+    bool mixed;                 // float32 label sweep, see Damm::setPrecision
+    bool trackLogLik;           // log mixture likelihood of every sweep, exported to logLogLik.csv
+    bool grouped;               // data sorted by label into contiguous blocks, see Damm::setGrouping
+    StatsMode statsMode;        // how the sweep maintains the sufficient statistics, see StatsMode
+    uint32_t statsRefresh;      // incremental statistics rebuilt every that many sweeps, see StatsStore::setRefresh
+    KarcherOptions karcher;     // stopping rule of the Karcher mean
+    LaunchOptions launch;       // stopping rule of the restricted Gibbs scans of split/merge proposals
+    bool subClusters;           // split moves proposed every iteration from persistent sub-clusters
+    MoveOptions moves;          // schedule of the split/merge proposals
+    ExecutionContext exec;
+};
+
+
+
+void checkAgreement(double agreement)
+{
+    /**
+     * The float sweep may only flip the most probable label of observations sitting on a decision boundary;
+     * anything beyond this tolerance points at ill-conditioned components and double precision should be used
+     */
+    const double tolerance = 1e-3;
+
+    std::cout << "Mixed precision label agreement: " << 100 * agreement << "%" << std::endl;
+    if (1 - agreement > tolerance)
+        std::cerr << "Warning: mixed precision disagrees with double on " << 100 * (1 - agreement)
+                  << "% of the labels, consider --precision double" << std::endl;
+}
+
+
+
+void exportLogLogLik(const std::filesystem::path &logPath, const vector<double> &logLogLik)
+{
+    std::ofstream fout_logLogLik(logPath / "logLogLik.csv");
+    for (size_t i=0; i < logLogLik.size(); ++i)
+        fout_logLogLik << logLogLik[i] << std::endl;
+    fout_logLogLik.close();
+}
+
+
+
+template<int dim>
+Eigen::VectorXi runDammIncrem(const Eigen::MatrixXd &Data, const Eigen::MatrixXd &sigma_0, const Eigen::VectorXd &mu_0, double nu_0, double kappa_0, 
+double sigmaDir_0, int init, int iter, double alpha, const Eigen::VectorXi &assignment_arr, const RunOptions &opt, vector<double> &logLogLik)
+{
+    NiwDamm<double, dim> niwDamm(sigma_0, mu_0, nu_0, kappa_0, sigmaDir_0);
+    niwDamm.setKarcher(opt.karcher);
+    Damm<NiwDamm<double, dim>> damm(Data, init, alpha, niwDamm, opt.seed, assignment_arr);
+    damm.setPrecision(opt.mixed);
+    damm.setExecution(opt.exec);
+    damm.setGrouping(opt.grouped);
+    damm.setStatsMode(opt.statsMode, opt.statsRefresh);
+    damm.setLogLikTracking(opt.trackLogLik);
+
+    for (int t=1; t<iter+1; ++t)    {
+        std::cout<<"------------ t="<<t<<" -------------"<<std::endl;
+        std::cout << "Number of components: " << damm.getK() << endl;      
+        
+        damm.sampleCoefficientsParameters();
+        damm.sampleLabels_increm();
+        if (opt.trackLogLik)
+            std::cout << "Log likelihood: " << damm.getLogLogLik().back() << std::endl;
+        damm.reorderAssignments();
+        damm.updateIndexLists();   
+    
+    }
+
+    if (opt.mixed)
+        checkAgreement(damm.labelAgreement());
+    logLogLik = damm.getLogLogLik();
+    return damm.getLabels();
+}
+
+
+template<int dim>
+Eigen::VectorXi runDamm(const Eigen::MatrixXd &Data, const Eigen::MatrixXd &sigma_0, const Eigen::VectorXd &mu_0, double nu_0, double kappa_0, 
+double sigmaDir_0, int init, int iter, double alpha, const RunOptions &opt, vector<double> &logLogLik)
+{
+    NiwDamm<double, dim> niwDamm(sigma_0, mu_0, nu_0, kappa_0, sigmaDir_0);
+    niwDamm.setKarcher(opt.karcher);
+    Damm<NiwDamm<double, dim>> damm(Data, init, alpha, niwDamm, opt.seed);
+    MoveScheduler moves(opt.moves);
+    damm.setPrecision(opt.mixed);
+    damm.setExecution(opt.exec);
+    damm.setGrouping(opt.grouped);
+    damm.setStatsMode(opt.statsMode, opt.statsRefresh);
+    damm.setLaunch(opt.launch);
+    damm.setSubClusters(opt.subClusters);
+    damm.setLogLikTracking(opt.trackLogLik);
+
+    // wall time of the split/merge moves and of the Gibbs sweeps, reported apart at the end of the run
+    typedef std::chrono::steady_clock Clock;
+    std::chrono::duration<double> moveTime(0), sweepTime(0);
+    for (int t=1; t<iter+1; ++t)    {
+        std::cout<<"------------ t="<<t<<" -------------"<<std::endl;
+        std::cout << "Number of components: " << damm.getK() << endl;    
+
+        auto t0 = Clock::now();
+        if (opt.subClusters && damm.subClusterSplits() > 0)
+            damm.updateIndexLists();
+        moves.run(t, damm);
+
+        auto t1 = Clock::now();
+        damm.sampleCoefficientsParameters();
+        damm.sampleLabels();
+        if (opt.trackLogLik)
+            std::cout << "Log likelihood: " << damm.getLogLogLik().back() << std::endl;
+        damm.reorderAssignments();
+        damm.updateIndexLists();
+
+        moveTime  += t1 - t0;
+        sweepTime += Clock::now() - t1;
+    }
+    std::cout << "Time in split/merge moves: " << moveTime.count() << " s" << std::endl;
+    std::cout << "Time in Gibbs sweeps: " << sweepTime.count() << " s" << std::endl;
+
+    if (opt.mixed)
+        checkAgreement(damm.labelAgreement());
+    logLogLik = damm.getLogLogLik();
+    return damm.getLabels();
+}
+
+
+template<int dim>
+Eigen::VectorXi runDpmm(const Eigen::MatrixXd &Data, const Eigen::MatrixXd &sigma_0, const Eigen::VectorXd &mu_0, double nu_0, double kappa_0, 
+int base, int init, int iter, double alpha, const RunOptions &opt, vector<double> &logLogLik)
+{
+    Niw<double, dim> niw(sigma_0, mu_0, nu_0, kappa_0, base);
+    Dpmm<Niw<double, dim>> dpmm(Data, init, alpha, niw, opt.seed, base);
+    dpmm.setExecution(opt.exec);
+    dpmm.setStatsMode(opt.statsMode, opt.statsRefresh);
+    dpmm.setLogLikTracking(opt.trackLogLik);
+    for (int t=0; t<iter; ++t){
+        std::cout<<"------------ t="<<t<<" -------------"<<std::endl;
+        dpmm.sampleCoefficientsParameters();
+        dpmm.sampleLabels();
+        if (opt.trackLogLik)
+            std::cout << "Log likelihood: " << dpmm.getLogLogLik().back() << std::endl;
+        dpmm.reorderAssignments();
+        dpmm.updateIndexLists();
+        std::cout << "Number of components: " << dpmm.getK() << std::endl;
+    }
+    logLogLik = dpmm.getLogLogLik();
+    return dpmm.getLabels();
+    // logZ.push_back(z);
+    // logZ        = dpmm.logZ_;
+    // logNum      = dpmm.logNum_;
+    // logLogLik   = dpmm.logLogLik_;
+}
+
+
+
 int main(int argc, char **argv)
 {   
     /*---------------------------------------------------*/
     //----------------- Command-line Input ---------------
     /*---------------------------------------------------*/
 
-    // std::srand(seed);
-    uint64_t seed = time(0);
-    // uint64_t seed = 1671503159;
-    boost::mt19937 rndGen(seed);
-
     std::cout << "Hello Parallel World" << std::endl;
     po::options_description desc("Allowed options");
     desc.add_options()
@@ -36,6 +191,33 @@ int main(int argc, char **argv)
         ("iter"         , po::value<int>()->required()      , "number of iteration")
         ("alpha"        , po::value<double>()->required()   , "concentration value")
         ("log"          , po::value<string>()->required()   , "path to log all the data")
+        ("threads"      , po::value<int>()->default_value(0)   , "number of threads; 0 uses every core (or OMP_NUM_THREADS)")
+        ("seed"         , po::value<uint64_t>()                , "random seed; defaults to the current time")
+        ("precision"    , po::value<string>()->default_value("double"), "label sweep precision: double, mixed (float32 sweep, double statistics)")
+        ("loglik"       , po::bool_switch()                    , "track the log-likelihood of every iteration and export logLogLik.csv")
+        ("stats"        , po::value<string>()->default_value("incremental"), "sufficient statistics: incremental (moves only, reproducible), fused (rebuilt within the label sweep)")
+        ("stats-refresh", po::value<int>()->default_value(20)  , "incremental statistics: rebuild them from the labels every this many sweeps to flush rounding; 0 never")
+        ("karcher-tol"  , po::value<double>()->default_value(0.01) , "Karcher mean: stop once the mean tangent step is below this norm")
+        ("karcher-iter" , po::value<int>()->default_value(100)     , "Karcher mean: maximum number of iterations")
+        ("grouped"      , po::bool_switch()                    , "keep the data sorted by label so that components are read as contiguous blocks")
+        ("launch-tol"   , po::value<double>()->default_value(0.01) , "split/merge: stop the restricted Gibbs scans once at most this fraction of points moves")
+        ("launch-min"   , po::value<int>()->default_value(10)      , "split/merge: minimum number of restricted Gibbs scans")
+        ("launch-max"   , po::value<int>()->default_value(50)      , "split/merge: maximum number of restricted Gibbs scans")
+        ("kmeans-restarts", po::value<int>()->default_value(3)     , "split/merge: number of k-means++ restarts of the initial two-means clustering")
+        ("subclusters"  , po::bool_switch()                    , "propose splits every iteration from two sub-clusters kept per component, instead of restricted Gibbs scans")
+        ("split-every"  , po::value<int>()->default_value(50)  , "split: iterations between two rounds of proposals; 0 disables")
+        ("split-start"  , po::value<int>()->default_value(50)  , "split: first iteration of a round")
+        ("split-stop"   , po::value<int>()->default_value(250) , "split: no round from this iteration on; 0 never stops")
+        ("split-min-size", po::value<int>()->default_value(5)  , "split: only components of more observations are proposed")
+        ("split-max"    , po::value<int>()->default_value(0)   , "split: proposals per round, the largest components first; 0 proposes all")
+        ("merge-every"  , po::value<int>()->default_value(0)   , "merge: iterations between two rounds of proposals; 0 disables")
+        ("merge-start"  , po::value<int>()->default_value(30)  , "merge: first iteration of a round")
+        ("merge-stop"   , po::value<int>()->default_value(175) , "merge: no round from this iteration on; 0 never stops")
+        ("merge-min-size", po::value<int>()->default_value(0)  , "merge: only pairs of more observations together are proposed")
+        ("merge-max"    , po::value<int>()->default_value(0)   , "merge: candidate pairs per round; 0 takes as many as components")
+        ("merge-similarity", po::value<int>()->default_value(2), "merge: candidate pairs, 0/1 neighbouring labels, 2 closest means, 3 smallest KL divergence among the nearest-mean pairs")
+        ("merge-accepted", po::value<int>()->default_value(1)  , "merge: a round stops after this many accepted merges; 0 never stops early")
+        ("moves-adaptive", po::bool_switch()                   , "halve the period of a move when most proposals are accepted, double it when few are")
     ;
 
     po::variables_map vm;
@@ -59,6 +241,58 @@ int main(int argc, char **argv)
     double alpha = vm["alpha"].as<double>();
     std::filesystem::path logPath = vm["log"].as<string>();
 
+    string precision = vm["precision"].as<string>();
+    if (precision != "double" && precision != "mixed") {
+        std::cerr << "Error: precision must be either double or mixed" << std::endl;
+        return 1;
+    }
+
+    string stats = vm["stats"].as<string>();
+    if (stats != "incremental" && stats != "fused") {
+        std::cerr << "Error: stats must be either incremental or fused" << std::endl;
+        return 1;
+    }
+
+    RunOptions opt;
+    opt.mixed       = (precision == "mixed");
+    opt.trackLogLik = vm["loglik"].as<bool>();
+    opt.grouped     = vm["grouped"].as<bool>();
+    opt.statsMode   = (stats == "fused") ? StatsMode::fused : StatsMode::incremental;
+    opt.statsRefresh = std::max(0, vm["stats-refresh"].as<int>());
+    opt.karcher.tolerance = vm["karcher-tol"].as<double>();
+    opt.karcher.maxIter   = vm["karcher-iter"].as<int>();
+    opt.launch.tolerance  = vm["launch-tol"].as<double>();
+    opt.launch.minScans   = std::max(1, vm["launch-min"].as<int>());
+    opt.launch.maxScans   = std::max<int>(opt.launch.minScans, vm["launch-max"].as<int>());
+    opt.launch.kmeans.restarts = std::max(1, vm["kmeans-restarts"].as<int>());
+    opt.subClusters = vm["subclusters"].as<bool>();
+
+    auto moveRule = [&](const string &move) {
+        return MoveRule{uint32_t(std::max(0, vm[move + "-every"].as<int>())), uint32_t(std::max(0, vm[move + "-start"].as<int>())), 
+                        uint32_t(std::max(0, vm[move + "-stop"].as<int>())), uint32_t(std::max(0, vm[move + "-min-size"].as<int>())), 
+                        uint32_t(std::max(0, vm[move + "-max"].as<int>()))};
+    };
+    opt.moves.split = moveRule("split");
+    opt.moves.merge = moveRule("merge");
+    opt.moves.mergeSimilarity = vm["merge-similarity"].as<int>();
+    opt.moves.mergeAccepted   = std::max(0, vm["merge-accepted"].as<int>());
+    opt.moves.adaptive        = vm["moves-adaptive"].as<bool>();
+    if (opt.subClusters)
+        opt.moves.split.every = 0;   // the sub-clusters propose splits every iteration already
+
+    /**
+     * Every draw comes from a counter-based Philox stream keyed by the seed, so a run is reproducible from its seed
+     * regardless of the number of threads and of the OpenMP schedule
+     */
+    opt.seed = vm.count("seed") ? vm["seed"].as<uint64_t>() : uint64_t(time(0));
+    std::cout << "Seed: " << opt.seed << std::endl;
+
+    opt.exec = ExecutionContext(vm["threads"].as<int>());
+    Eigen::setNbThreads(opt.exec.threads);
+    std::cout << "Threads: " << opt.exec.threads << std::endl;
+
+    vector<double> logLogLik;
+
 
     /*---------------------------------------------------*/
     //------------------- Python Input -------------------
@@ -113,24 +347,22 @@ int main(int argc, char **argv)
     // std::cout << assignment_arr << std::endl;    
     Eigen::Matrix<std::int32_t, Eigen::Dynamic, 1> z;
     if (assignment_arr(0) != -1){
-        NiwDamm<double> niwDamm(sigma_0, mu_0, nu_0, kappa_0, sigmaDir_0, rndGen);
-        Damm<NiwDamm<double>> damm(Data, init, alpha, niwDamm, rndGen, assignment_arr);
-
-        for (int t=1; t<iter+1; ++t)    {
-            std::cout<<"------------ t="<<t<<" -------------"<<std::endl;
-            std::cout << "Number of components: " << damm.getK() << endl;      
-            
-            damm.sampleCoefficientsParameters();
-            damm.sampleLabels_increm();
-            damm.reorderAssignments();
-            damm.updateIndexLists();   
-        
-        }
-        
-        z = damm.getLabels();
+        /**
+         * The sampler is instantiated with compile-time dimensions for planar and spatial trajectories, i.e. 
+         * 2D or 3D position plus a unit direction; any other dimension falls back to the dynamic-size code
+         */
+        if (dim == 4)
+            z = runDammIncrem<2>(Data, sigma_0, mu_0, nu_0, kappa_0, sigmaDir_0, init, iter, alpha, assignment_arr, opt, logLogLik);
+        else if (dim == 6)
+            z = runDammIncrem<3>(Data, sigma_0, mu_0, nu_0, kappa_0, sigmaDir_0, init, iter, alpha, assignment_arr, opt, logLogLik);
+        else
+            z = runDammIncrem<Dynamic>(Data, sigma_0, mu_0, nu_0, kappa_0, sigmaDir_0, init, iter, alpha, assignment_arr, opt, logLogLik);
+
         std::ofstream outputFile(logPath / "assignment.bin", std::ios::binary);
         outputFile.write(reinterpret_cast<const char*>(z.data()), z.size() * sizeof(std::int32_t));
         outputFile.close();
+        if (opt.trackLogLik)
+            exportLogLogLik(logPath, logLogLik);
         
         return 0;
     }
@@ -146,58 +378,26 @@ int main(int argc, char **argv)
     // vector<double> logLogLik;
 
     if (base==0)  {
-        boost::random::uniform_int_distribution<> uni(0, 3);
-        NiwDamm<double> niwDamm(sigma_0, mu_0, nu_0, kappa_0, sigmaDir_0, rndGen);
-        Damm<NiwDamm<double>> damm(Data, init, alpha, niwDamm, rndGen);
-        for (int t=1; t<iter+1; ++t)    {
-            std::cout<<"------------ t="<<t<<" -------------"<<std::endl;
-            std::cout << "Number of components: " << damm.getK() << endl;    
-  
-            if (t%50==0 && t> 49 && t<250){
-                vector<vector<int>> indexLists = damm.getIndexLists();
-                for (int l=0; l<indexLists.size(); ++l){  
-                    if (indexLists[l].size() > 5)
-                        damm.splitProposal(indexLists[l]);
-                }
-                damm.updateIndexLists();
-            }
-            // else if (t%3==0 && t>30 && t<175){ 
-            //     vector<vector<int>> indexLists = damm.getIndexLists();
-            //     vector<array<int, 2>>  mergeIndexLists = damm.computeSimilarity(int(damm.getK()), uni(rndGen));
-            //     for (int i =0; i < mergeIndexLists.size(); ++i){
-            //         if (!damm.mergeProposal(indexLists[mergeIndexLists[i][0]], indexLists[mergeIndexLists[i][1]]))
-            //             break;
-            //     }
-            //     damm.reorderAssignments();
-            //     damm.updateIndexLists();
-            // }
-            // else{
-            damm.sampleCoefficientsParameters();
-            damm.sampleLabels();
-            damm.reorderAssignments();
-            damm.updateIndexLists();
-            // }
-        }
-        z = damm.getLabels();
-
+        if (dim == 4)
+            z = runDamm<2>(Data, sigma_0, mu_0, nu_0, kappa_0, sigmaDir_0, init, iter, alpha, opt, logLogLik);
+        else if (dim == 6)
+            z = runDamm<3>(Data, sigma_0, mu_0, nu_0, kappa_0, sigmaDir_0, init, iter, alpha, opt, logLogLik);
+        else
+            z = runDamm<Dynamic>(Data, sigma_0, mu_0, nu_0, kappa_0, sigmaDir_0, init, iter, alpha, opt, logLogLik);
     }
 
     else {
-        Niw<double> niw(sigma_0, mu_0, nu_0, kappa_0, rndGen, base);
-        Dpmm<Niw<double>> dpmm(Data, init, alpha, niw, rndGen, base);
-        for (int t=0; t<iter; ++t){
-            std::cout<<"------------ t="<<t<<" -------------"<<std::endl;
-            dpmm.sampleCoefficientsParameters();
-            dpmm.sampleLabels();
-            dpmm.reorderAssignments();
-            dpmm.updateIndexLists();
-            std::cout << "Number of components: " << dpmm.getK() << std::endl;
-        }
-        z = dpmm.getLabels();
-        // logZ.push_back(z);
-        // logZ        = dpmm.logZ_;
-        // logNum      = dpmm.logNum_;
-        // logLogLik   = dpmm.logLogLik_;
+        int dimNiw = (base == 1) ? dim/2 : dim;
+        if (dimNiw == 2)
+            z = runDpmm<2>(Data, sigma_0, mu_0, nu_0, kappa_0, base, init, iter, alpha, opt, logLogLik);
+        else if (dimNiw == 3)
+            z = runDpmm<3>(Data, sigma_0, mu_0, nu_0, kappa_0, base, init, iter, alpha, opt, logLogLik);
+        else if (dimNiw == 4)
+            z = runDpmm<4>(Data, sigma_0, mu_0, nu_0, kappa_0, base, init, iter, alpha, opt, logLogLik);
+        else if (dimNiw == 6)
+            z = runDpmm<6>(Data, sigma_0, mu_0, nu_0, kappa_0, base, init, iter, alpha, opt, logLogLik);
+        else
+            z = runDpmm<Dynamic>(Data, sigma_0, mu_0, nu_0, kappa_0, base, init, iter, alpha, opt, logLogLik);
     }
 
 
@@ -209,6 +409,8 @@ int main(int argc, char **argv)
     std::ofstream outputFile(logPath / "assignment.bin", std::ios::binary);
     outputFile.write(reinterpret_cast<const char*>(z.data()), z.size() * sizeof(std::int32_t));
     outputFile.close();
+    if (opt.trackLogLik)
+        exportLogLogLik(logPath, logLogLik);
 
 
     // string logPath_logNum = logPath + "logNum.csv";
@@ -217,12 +419,6 @@ int main(int argc, char **argv)
     //     fout_logNum << logNum[i] << endl;
     // fout_logNum.close();
 
-    // string logPath_logLogLik = logPath + "logLogLik.csv";
-    // ofstream fout_logLogLik(logPath_logLogLik.data(),ofstream::out);
-    // for (int i=0; i < logLogLik.size(); ++i)
-    //     fout_logLogLik << logLogLik[i] << endl;
-    // fout_logLogLik.close();
-
 
     // ofstream outputFile(logPath + "logZ.csv");
     // if (outputFile.is_open()) {
@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <numeric>
+#include "membership.hpp"
+
+
+
+void Membership::build(const VectorXi &z, uint32_t K, const ExecutionContext &exec)
+{
+  /**
+   * This method sorts the observations by label with a parallel counting sort
+   *
+   * @param z labels in [0, K), e.g. right after reorderAssignments()
+   *
+   * @note every thread owns one static range of observations: it counts its labels, then, after a serial exclusive
+   * scan over (label, thread), scatters its indices to the slots reserved for it; the result is stable, hence
+   * identical for any number of threads
+   */
+  const uint32_t N = z.size();
+  const int maxThreads = exec.threadsFor(N, 4096);
+
+  indices_.resize(N);
+  offsets_.assign(K+1, 0);
+  hist_.assign(uint64_t(maxThreads) * K, 0);
+
+  #pragma omp parallel num_threads(maxThreads)
+  {
+    const int numThreads = omp_get_num_threads();
+    const int tid        = omp_get_thread_num();
+    const uint32_t chunk = (N + numThreads - 1) / numThreads;
+    const uint32_t begin = std::min<uint64_t>(N, uint64_t(tid) * chunk);
+    const uint32_t end   = std::min<uint64_t>(N, uint64_t(begin) + chunk);
+    uint32_t *hist = hist_.data() + uint64_t(tid) * K;
+
+    for (uint32_t ii=begin; ii<end; ++ii)
+      ++hist[z[ii]];
+
+    #pragma omp barrier
+    #pragma omp single
+    {
+      uint32_t run = 0;
+      for (uint32_t kk=0; kk<K; ++kk) {
+        offsets_[kk] = run;
+        for (int tt=0; tt<numThreads; ++tt) {
+          uint32_t count = hist_[uint64_t(tt) * K + kk];
+          hist_[uint64_t(tt) * K + kk] = run;
+          run += count;
+        }
+      }
+      offsets_[K] = run;
+    }
+
+    for (uint32_t ii=begin; ii<end; ++ii)
+      indices_[hist[z[ii]]++] = ii;
+  }
+}
+
+
+
+void Membership::build(const std::vector<IndexView> &indexLists)
+{
+  /**
+   * This method concatenates given index lists, e.g. the two sub-clusters of a split/merge proposal, of which the
+   * members are already known
+   */
+  offsets_.assign(1, 0);
+  for (const auto &indexList : indexLists)
+    offsets_.push_back(offsets_.back() + indexList.size());
+
+  indices_.resize(offsets_.back());
+  for (uint32_t kk=0; kk<indexLists.size(); ++kk)
+    std::copy(indexLists[kk].begin(), indexLists[kk].end(), this ->slot(kk));
+}
+
+
+
+void Membership::reset(const uint32_t *counts, uint32_t K)
+{
+  /**
+   * This method reserves counts[k] slots for each of the K components, to be filled in through slot(k) by the caller
+   */
+  offsets_.assign(1, 0);
+  for (uint32_t kk=0; kk<K; ++kk)
+    offsets_.push_back(offsets_.back() + counts[kk]);
+  indices_.resize(offsets_.back());
+}
+
+
+
+void Membership::renumber()
+{
+  /**
+   * This method replaces the indices by 0, 1, ..., N-1 and keeps the offsets, i.e. the lists once the observations
+   * themselves have been permuted into the order of the lists, see permuteRows()
+   */
+  std::iota(indices_.begin(), indices_.end(), 0);
+}
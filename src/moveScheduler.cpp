@@ -0,0 +1,81 @@
+#include <iostream>
+#include <algorithm>
+#include "moveScheduler.hpp"
+#include "niwDamm.hpp"
+
+
+
+MoveScheduler::MoveScheduler(const MoveOptions &opt)
+: opt_(opt), splitNext_(opt.split.start), mergeNext_(opt.merge.start)
+{
+}
+
+
+
+bool MoveScheduler::due(const MoveRule &rule, uint32_t next, int t) const
+{
+  return rule.every > 0 && t >= int(next) && (rule.stop == 0 || t < int(rule.stop));
+}
+
+
+
+template <class dist_t>
+bool MoveScheduler::run(int t, Damm<dist_t> &damm)
+{
+  /**
+   * This method runs the round of moves due at iteration t, if any
+   *
+   * @return whether a round took place, after which the labels and index lists of the sampler are up to date
+   */
+  if (this ->splitDue(t)) {
+    uint32_t numProposed = 0;
+    int numAccepted = damm.splitProposals(damm.getIndexLists(), opt_.split.minSize, opt_.split.maxProposals, &numProposed);
+    damm.updateIndexLists();
+    this ->record("Split", opt_.split, splitNext_, splitRate_, t, numProposed, numAccepted);
+    return true;
+  }
+
+  if (this ->mergeDue(t)) {
+    uint32_t numProposed = 0;
+    int numAccepted = damm.mergeProposals(opt_.merge.maxProposals, opt_.mergeSimilarity, opt_.merge.minSize,
+      opt_.mergeAccepted, &numProposed);
+    damm.reorderAssignments();
+    damm.updateIndexLists();
+    this ->record("Merge", opt_.merge, mergeNext_, mergeRate_, t, numProposed, numAccepted);
+    return true;
+  }
+  return false;
+}
+
+
+
+void MoveScheduler::record(const char *move, MoveRule &rule, uint32_t &next, double &rate, int t, uint32_t numProposed,
+  int numAccepted)
+{
+  /**
+   * This method updates the running acceptance rate of a move after a round, rescales its period when adaptive, and
+   * schedules its next round
+   */
+  if (numProposed > 0) {
+    double rateRound = double(numAccepted) / numProposed;
+    rate = (rate < 0) ? rateRound : (1 - opt_.rateWeight) * rate + opt_.rateWeight * rateRound;
+
+    if (opt_.adaptive) {
+      uint32_t every = rule.every;
+      if (rate > opt_.rateHigh)
+        rule.every = std::max<uint32_t>(1, rule.every / 2);
+      else if (rate < opt_.rateLow)
+        rule.every = std::min<uint32_t>(std::max<uint32_t>(1, opt_.maxEvery), 2 * rule.every);
+      if (rule.every != every)
+        std::cout << move << " moves: acceptance rate " << rate << ", now every " << rule.every << " iterations" << std::endl;
+    }
+  }
+  next = t + rule.every;
+}
+
+
+
+
+template bool MoveScheduler::run(int t, Damm<NiwDamm<double>> &damm);
+template bool MoveScheduler::run(int t, Damm<NiwDamm<double, 2>> &damm);
+template bool MoveScheduler::run(int t, Damm<NiwDamm<double, 3>> &damm);
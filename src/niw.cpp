@@ -1,5 +1,6 @@
 #include "niw.hpp"
 #include "niwDamm.hpp"
+#include "wishart.hpp"
 #include <cmath>
 #include <boost/math/special_functions/gamma.hpp>
 #include <boost/random/chi_squared_distribution.hpp>
@@ -9,29 +10,27 @@
 #define PI 3.141592653589793
 
 
-template<class T>
-Niw<T>::Niw(const MatrixXd &sigma, const VectorXd &mu, T nu, T kappa, boost::mt19937 &rndGen, int base)
-: nu_(nu), kappa_(kappa), rndGen_(rndGen) {
+template<class T, int dim>
+Niw<T, dim>::Niw(const MatrixXd &sigma, const VectorXd &mu, T nu, T kappa, int base)
+: nu_(nu), kappa_(kappa) {
   
   if (base == 1)      dim_ = mu.rows()/2;
   else if (base == 2) dim_ = mu.rows();
 
-  mu_    = mu(seq(0, dim_-1), all);
-  sigma_ = sigma(seq(0, dim_-1), seq(0, dim_-1));
+  mu_    = mu.head(dim_);
+  sigma_ = sigma.topLeftCorner(dim_, dim_);
 };
 
 
-template<class T>
-Niw<T>::Niw(const MatrixXd &sigma, const VectorXd &mu, T nu, T kappa, boost::mt19937 &rndGen)
-:sigma_(sigma), mu_(mu), nu_(nu), kappa_(kappa), dim_(mu.rows()), rndGen_(rndGen) 
+template<class T, int dim>
+Niw<T, dim>::Niw(const Matrix<T,dim,dim> &sigma, const Matrix<T,dim,1> &mu, T nu, T kappa)
+:sigma_(sigma), mu_(mu), nu_(nu), kappa_(kappa), dim_(mu.rows()) 
 {
   /**
    * This Niw distribution constructor is only called when:
    * 1. called from NiwDamm constructor
    * 2. called from Niw posterior
    * 
-   * @param rndGen the random number generator
-   * 
    * @note no base needed, alway and only contain position for split/merge
    * 
    */
@@ -39,80 +38,126 @@ Niw<T>::Niw(const MatrixXd &sigma, const VectorXd &mu, T nu, T kappa, boost::mt1
 
 
 
-template<class T>
-Niw<T> Niw<T>::posterior(const Matrix<T,Dynamic, Dynamic> &x_k)
+template<class T, int dim>
+Niw<T, dim> Niw<T, dim>::posterior(const rows_t &x_k)
 {  
   getSufficientStatistics(x_k);
-  return Niw<T>(
+  return this ->posterior();
+};
+
+
+
+template<class T, int dim>
+Niw<T, dim> Niw<T, dim>::posterior(const SuffStats<T,dim> &stats, const Matrix<T,dim,1> &shift)
+{  
+  /**
+   * This method computes the posterior from accumulated statistics at O(d^2) cost, independent of the number of
+   * member observations
+   */
+  getSufficientStatistics(stats, shift);
+  return this ->posterior();
+};
+
+
+
+template<class T, int dim>
+T Niw<T, dim>::logMarginal(const SuffStats<T,dim> &stats, const Matrix<T,dim,1> &shift)
+{  
+  /**
+   * This method computes the log marginal likelihood of the member observations of stats, i.e. with the mean and
+   * covariance integrated out against this distribution
+   *
+   * @note p(x) = pi^{-nd/2} Gamma_d(nu_n/2) / Gamma_d(nu/2) |sigma|^{nu/2} / |sigma_n|^{nu_n/2} (kappa/kappa_n)^{d/2},
+   * see https://www.cs.ubc.ca/~murphyk/Papers/bayesGauss.pdf eq. 266
+   */
+  if (stats.count == 0)
+    return 0;
+
+  Niw<T, dim> post = this ->posterior(stats, shift);
+  const T d = dim_;
+
+  T logProb = -T(stats.count) * d / 2 * std::log(PI) + d / 2 * (std::log(kappa_) - std::log(post.kappa_));
+  logProb += nu_ * sigma_.llt().matrixLLT().diagonal().array().log().sum();
+  logProb -= post.nu_ * post.sigma_.llt().matrixLLT().diagonal().array().log().sum();
+  for (uint32_t j=0; j<dim_; ++j)
+    logProb += std::lgamma((post.nu_ - j) / 2) - std::lgamma((nu_ - j) / 2);
+  return logProb;
+};
+
+
+
+template<class T, int dim>
+Niw<T, dim> Niw<T, dim>::posterior() const
+{  
+  return Niw<T, dim>(
     sigma_+scatter_ + ((kappa_*count_)/(kappa_+count_))*(mean_-mu_)*(mean_-mu_).adjoint(), 
     (kappa_*mu_+ count_*mean_)/(kappa_+count_),
     nu_+count_,
-    kappa_+count_, 
-    rndGen_);
+    kappa_+count_);
 };
 
 
 
-template<class T>
-void Niw<T>::getSufficientStatistics(const Matrix<T,Dynamic, Dynamic> &x_k)
+template<class T, int dim>
+void Niw<T, dim>::getSufficientStatistics(const rows_t &x_k)
 {
-	mean_ = x_k.colwise().mean();
-  MatrixXd x_k_mean = x_k.rowwise() - mean_.transpose();
+	mean_ = x_k.colwise().mean().transpose();
+  Matrix<T,Dynamic,dim> x_k_mean = x_k.rowwise() - mean_.transpose();
   scatter_ = x_k_mean.adjoint() * x_k_mean;
 	count_ = x_k.rows();
 };
 
 
 
-template<class T>
-Gauss<T> Niw<T>::samplePosteriorParameter(const Matrix<T,Dynamic, Dynamic>& x_k)
+template<class T, int dim>
+void Niw<T, dim>::getSufficientStatistics(const SuffStats<T,dim> &stats, const Matrix<T,dim,1> &shift)
 {
-  Niw<T> posterior = this ->posterior(x_k);
-  return posterior.sampleParameter();
-}
+  mean_    = stats.mean(shift);
+  scatter_ = stats.scatter();
+  count_   = stats.count;
+};
 
 
 
-template<class T>
-Gauss<T> Niw<T>::sampleParameter()
+template<class T, int dim>
+Gauss<T, dim> Niw<T, dim>::samplePosteriorParameter(const Matrix<T,Dynamic, Dynamic>& x_k, Philox4x32 &rndGen)
 {
-  Matrix<T,Dynamic,Dynamic> sampledCov(dim_,dim_);
-  Matrix<T,Dynamic,Dynamic> sampledInvCov(dim_,dim_);
-  Matrix<T,Dynamic,1> sampledMean(dim_);
+  Niw<T, dim> posterior = this ->posterior(x_k);
+  return posterior.sampleParameter(rndGen);
+}
 
-  MatrixXd inv_scale_matrix = sigma_.inverse();
-  LLT<Matrix<T,Dynamic,Dynamic> > lltObj(inv_scale_matrix);
-  Matrix<T,Dynamic,Dynamic> cholFacotor = lltObj.matrixL();
 
-  Matrix<T,Dynamic,Dynamic> matrixA(dim_,dim_);
-  matrixA.setZero();
-  boost::random::normal_distribution<double> gauss_(0.0, 1.0);
-  for (int i=0; i<dim_; ++i){
-      for (int j=i; j<dim_; ++j){
-        if (i==j){
-          boost::random::chi_squared_distribution<> chiSq_(nu_-i);
-          matrixA(i, i) =  sqrt(chiSq_(rndGen_));
-        }
-        else 
-          matrixA(j, i) = gauss_(rndGen_);
-      }
-  }
-  sampledInvCov = cholFacotor * matrixA * matrixA.transpose() * cholFacotor.transpose();
-  sampledCov = sampledInvCov.inverse();
-
-  MatrixXd lowerMatrix = (sampledCov/kappa_).llt().matrixL();
 
+template<class T, int dim>
+Gauss<T, dim> Niw<T, dim>::sampleParameter(Philox4x32 &rndGen) const
+{
+  /**
+   * @param rndGen the stream the Wishart and normal draws are taken from; the distribution holds no generator
+   *
+   * @note the covariance is drawn as its Cholesky factor, which also scales the draw of the mean and is handed to the
+   * component as is; sigma_ is factorized once and nothing is inverted
+   */
+  Matrix<T,dim,dim> cholScale = sigma_.llt().matrixL();
+  Matrix<T,dim,dim> chol, invChol;
+  sampleInvWishartChol<T,dim>(cholScale, nu_, rndGen, chol, invChol);
+
+  Matrix<T,dim,1> sampledMean(dim_);
+  boost::random::normal_distribution<double> gauss_(0.0, 1.0);
   for (uint32_t i=0; i<dim_; ++i)
-    sampledMean[i] = gauss_(rndGen_);
-  sampledMean =  lowerMatrix * sampledMean + mu_;
+    sampledMean[i] = gauss_(rndGen);
+  sampledMean = mu_ + chol.template triangularView<Lower>() * sampledMean / std::sqrt(kappa_);
 
-  return Gauss<T>(sampledMean, sampledCov, rndGen_);
+  return Gauss<T, dim>(sampledMean, chol, invChol);
 };
 
 
 
 
 template class Niw<double>;
+template class Niw<double, 2>;
+template class Niw<double, 3>;
+template class Niw<double, 4>;
+template class Niw<double, 6>;
 
 
 
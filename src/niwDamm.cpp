@@ -1,5 +1,6 @@
 #include "niwDamm.hpp"
 #include "riem.hpp"
+#include "wishart.hpp"
 #include <cmath>
 #include <limits>
 #include <algorithm>
@@ -8,34 +9,33 @@
 #include <boost/random/normal_distribution.hpp>
 
 
-template<typename T>
-NiwDamm<T>::NiwDamm(const Matrix<T,Dynamic,Dynamic>& sigma, 
-  const Matrix<T,Dynamic,Dynamic>& mu, T nu,  T kappa, T sigmaDir, boost::mt19937 &rndGen):
-  nu_(nu), kappa_(kappa), sigmaDir_(sigmaDir), rndGen_(rndGen) 
+template<typename T, int dim>
+NiwDamm<T, dim>::NiwDamm(const Matrix<T,Dynamic,Dynamic>& sigma, 
+  const Matrix<T,Dynamic,Dynamic>& mu, T nu,  T kappa, T sigmaDir):
+  nu_(nu), kappa_(kappa), sigmaDir_(sigmaDir) 
 {
   /**
    * This is the NIWDir distribution constructor where the hyperparameters are sparsed from the standard inputs
    * called for IW Gibbs sampler
    * 
    * @param dim is the dimension d of the state variable; i.e. \xi_{pos} in paper
-   * @param rndGen the random number generator
    * @param NIW_ptr is created as the pointer to a Niw base distribution
    * 
    */
 
   dim_ = mu.rows()/2;
-  muPos_  = mu(seq(0, dim_-1), all);
-  sigmaPos_ = sigma(seq(0, dim_-1), seq(0, dim_-1));
+  muPos_  = mu.col(0).head(dim_);
+  sigmaPos_ = sigma.topLeftCorner(dim_, dim_);
 
-  NIW_ptr = std::make_shared<Niw<T>> (sigmaPos_, muPos_, nu_, kappa_, rndGen_);
+  NIW_ptr = std::make_shared<Niw<T, dim>> (sigmaPos_, muPos_, nu_, kappa_);
 };
 
 
 
-template<typename T>
-NiwDamm<T>::NiwDamm(const Matrix<T,Dynamic,Dynamic>& sigmaPos, const Matrix<T,Dynamic,1>& muPos, T nu, T kappa, T sigmaDir, const Matrix<T,Dynamic,1>& muDir, 
-  T count, boost::mt19937 &rndGen):
-  sigmaPos_(sigmaPos), muPos_(muPos), nu_(nu), kappa_(kappa), sigmaDir_(sigmaDir), muDir_(muDir), count_(count), dim_(muPos_.rows()), rndGen_(rndGen)
+template<typename T, int dim>
+NiwDamm<T, dim>::NiwDamm(const Matrix<T,dim,dim>& sigmaPos, const Matrix<T,dim,1>& muPos, T nu, T kappa, T sigmaDir, const Matrix<T,dim,1>& muDir, 
+  T count):
+  sigmaPos_(sigmaPos), muPos_(muPos), nu_(nu), kappa_(kappa), sigmaDir_(sigmaDir), muDir_(muDir), count_(count), dim_(muPos_.rows())
 {
   /**
    * This NiwDamm distribution constructor is only called when:
@@ -47,81 +47,113 @@ NiwDamm<T>::NiwDamm(const Matrix<T,Dynamic,Dynamic>& sigmaPos, const Matrix<T,Dy
 
 
 
-template<typename T>
-void NiwDamm<T>::getSufficientStatistics(const Matrix<T,Dynamic, Dynamic>& x_k)
+template<typename T, int dim>
+void NiwDamm<T, dim>::getSufficientStatistics(const rows_t &x_k)
 {
-  const MatrixXd xPos_k = x_k(all, seq(0, dim_-1));
-  const MatrixXd xDir_k = x_k(all, seq(dim_, last));
+  const auto xPos_k = x_k.leftCols(dim_);
+  const dirRows_t xDir_k = x_k.rightCols(dim_);
 
   meanPos_ = xPos_k.colwise().mean().transpose();  
-  Matrix<T,Dynamic, Dynamic> x_k_mean; 
+  Matrix<T,Dynamic, dim> x_k_mean; 
   x_k_mean = xPos_k.rowwise() - meanPos_.transpose(); 
   scatterPos_ = (x_k_mean.adjoint() * x_k_mean); 
 
-  meanDir_ = karcherMean(xDir_k);
-
-  scatterDir_ = riemScatter(xDir_k, meanDir_); 
+  KarcherResult<T,dim> karcher = karcherMean(xDir_k, karcher_);
+  meanDir_    = karcher.mean;
+  scatterDir_ = karcher.scatter; 
 
   count_ = x_k.rows();
 };
 
 
-template<typename T>
-NiwDamm<T> NiwDamm<T>::posterior(const Matrix<T,Dynamic, Dynamic>& x_k)
+
+template<typename T, int dim>
+void NiwDamm<T, dim>::getSufficientStatistics(const SuffStats<T,dim> &stats, const Matrix<T,dim,1> &shift, 
+  const dirRows_t &xDir_k, const dir_t *warmDir)
+{
+  /**
+   * @param xDir_k the directions of the member observations; the Karcher mean is an iterative fixed point on the
+   * sphere and cannot be recovered from the resultant vector, hence still costs O(n_k d) per iteration
+   * @param warmDir optional mean direction of the same component in the previous iteration
+   *
+   * @note the iteration starts from warmDir, which typically converges in one or two passes; it falls back to the
+   * normalized resultant vector, taken from the statistics without a data pass, when warmDir is missing or lies in
+   * the opposite hemisphere
+   */
+  meanPos_    = stats.mean(shift);
+  scatterPos_ = stats.scatter();
+
+  dir_t init;
+  if (warmDir != nullptr && warmDir ->dot(stats.sumDir) > 0)
+    init = *warmDir;
+  else if (stats.sumDir.norm() > 0)
+    init = stats.sumDir / stats.sumDir.norm();
+  else
+    init = xDir_k.row(0).transpose();
+
+  KarcherResult<T,dim> karcher = karcherMean(xDir_k, karcher_, &init);
+  meanDir_    = karcher.mean;
+  scatterDir_ = karcher.scatter; 
+
+  count_ = stats.count;
+};
+
+
+template<typename T, int dim>
+NiwDamm<T, dim> NiwDamm<T, dim>::posterior(const rows_t &x_k)
 {
   getSufficientStatistics(x_k);
+  return this ->posterior();
+};
+
+
+template<typename T, int dim>
+NiwDamm<T, dim> NiwDamm<T, dim>::posterior(const SuffStats<T,dim> &stats, const Matrix<T,dim,1> &shift, 
+  const dirRows_t &xDir_k, const dir_t *warmDir)
+{
+  getSufficientStatistics(stats, shift, xDir_k, warmDir);
+  return this ->posterior();
+};
 
-  return NiwDamm<T>(
+
+template<typename T, int dim>
+NiwDamm<T, dim> NiwDamm<T, dim>::posterior() const
+{
+  return NiwDamm<T, dim>(
     sigmaPos_+scatterPos_ + ((kappa_*count_)/(kappa_+count_))*(meanPos_-muPos_)*(meanPos_-muPos_).transpose(),
     (kappa_*muPos_+ count_*meanPos_)/(kappa_+count_),
     nu_+count_,
     kappa_+count_,
     (nu_ * sigmaDir_ + scatterDir_)/(nu_+count_),
     meanDir_,
-    count_, 
-    rndGen_);
+    count_);
 };
 
 
-template<class T>
-gaussDamm<T> NiwDamm<T>::samplePosteriorParameter(const Matrix<T,Dynamic, Dynamic>& x_k)
+template<class T, int dim>
+gaussDamm<T, dim> NiwDamm<T, dim>::samplePosteriorParameter(const Matrix<T,Dynamic, Dynamic>& x_k, Philox4x32 &rndGen)
 {
-  NiwDamm<T> posterior = this ->posterior(x_k);
-  return posterior.sampleParameter();
+  NiwDamm<T, dim> posterior = this ->posterior(x_k);
+  return posterior.sampleParameter(rndGen);
 }
 
 
-template<class T>
-gaussDamm<T> NiwDamm<T>::sampleParameter()
+template<class T, int dim>
+gaussDamm<T, dim> NiwDamm<T, dim>::sampleParameter(Philox4x32 &rndGen) const
 {
-  Matrix<T,Dynamic,1> meanPos(dim_);
-  Matrix<T,Dynamic,Dynamic> covPos(dim_, dim_);
-  Matrix<T,Dynamic,1> meanDir(dim_);
-  T covDir;
-
-
-  LLT<Matrix<T,Dynamic,Dynamic> > lltObj(sigmaPos_);
-  Matrix<T,Dynamic,Dynamic> cholFacotor = lltObj.matrixL();
+  /**
+   * @note the positional covariance is drawn as its Cholesky factor, see sampleInvWishartChol, which also scales the
+   * draw of the mean and is handed to the component as is; sigmaPos_ is factorized once and nothing is inverted
+   */
+  Matrix<T,dim,dim> cholScale = sigmaPos_.llt().matrixL();
+  Matrix<T,dim,dim> cholPos, invCholPos;
+  sampleInvWishartChol<T,dim>(cholScale, nu_, rndGen, cholPos, invCholPos);
 
-  Matrix<T,Dynamic,Dynamic> matrixA(dim_, dim_);
-  matrixA.setZero();
+  Matrix<T,dim,1> meanPos(dim_);
   boost::random::normal_distribution<> gauss_(0.0, 1.0);
-  for (uint32_t i=0; i<dim_; ++i)  {
-    boost::random::chi_squared_distribution<> chiSq_(nu_-i);
-    matrixA(i,i) = sqrt(chiSq_(rndGen_)); 
-    for (uint32_t j=i+1; j<dim_; ++j)
-      matrixA(j, i) = gauss_(rndGen_);
-  }
-  covPos = matrixA.inverse()*cholFacotor;
-  covPos = covPos.transpose()*covPos;
-
-
-  lltObj.compute(covPos/kappa_);
-  cholFacotor = lltObj.matrixL();
-
   for (uint32_t i=0; i<dim_; ++i)
-    meanPos[i] = gauss_(rndGen_);
-  meanPos = muPos_ + cholFacotor * meanPos;
+    meanPos[i] = gauss_(rndGen);
+  meanPos = muPos_ + cholPos.template triangularView<Lower>() * meanPos / std::sqrt(kappa_);
 
   /**
    * Below implements the sampling of a variance from a posterior inverse chi-squared distribution
@@ -134,18 +166,18 @@ gaussDamm<T> NiwDamm<T>::sampleParameter()
    */
 
   boost::random::chi_squared_distribution<> chiSq_(nu_);
-  T inv_chi_sqrd = 1 / chiSq_(rndGen_);
-  covDir = inv_chi_sqrd * sigmaDir_ * nu_;
-
-  meanDir = muDir_;
+  T inv_chi_sqrd = 1 / chiSq_(rndGen);
+  T covDir = inv_chi_sqrd * sigmaDir_ * nu_;
 
 
-  return gaussDamm<T>(meanPos, covPos, meanDir, covDir, rndGen_);
+  return gaussDamm<T, dim>(meanPos, cholPos, invCholPos, muDir_, covDir);
 };
 
 
 
 template class NiwDamm<double>;
+template class NiwDamm<double, 2>;
+template class NiwDamm<double, 3>;
 
 
 
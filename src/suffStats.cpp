@@ -0,0 +1,220 @@
+#include "suffStats.hpp"
+
+
+
+template<typename T, int dim>
+void SuffStats<T, dim>::setZero(uint32_t dimPos)
+{
+  count = 0;
+  sum.setZero(dimPos);
+  outer.setZero(dimPos, dimPos);
+  sumDir.setZero(dimPos);
+}
+
+
+
+template<typename T, int dim>
+void StatsStore<T, dim>::build(const Matrix<T,Dynamic,Dynamic> &x, const VectorXi &z, uint32_t K, uint32_t dimPos, bool directional)
+{
+  /**
+   * This method accumulates the statistics of all K components from scratch
+   *
+   * @param x (N, dimPos) positions, or (N, 2 dimPos) positions followed by unit directions when directional
+   * @param z labels in [0, K)
+   *
+   * @note the shift is fixed to the global mean of the positions here and kept for the lifetime of the store
+   */
+  dimPos_      = dimPos;
+  directional_ = directional;
+  shift_       = x.leftCols(dimPos_).colwise().mean().transpose();
+
+  this ->resize(K);
+  for (uint32_t ii=0; ii<x.rows(); ++ii)
+    this ->add(x.row(ii), stats_[z[ii]], T(1));
+}
+
+
+
+template<typename T, int dim>
+void StatsStore<T, dim>::rebuild(const Matrix<T,Dynamic,Dynamic> &x, IndexView indexList, uint32_t k)
+{
+  /**
+   * This method recomputes the statistics of component k from its member list, e.g. after a split
+   */
+  if (k >= stats_.size())
+    this ->resize(k+1);
+
+  stats_[k].setZero(dimPos_);
+  for (int ii : indexList)
+    this ->add(x.row(ii), stats_[k], T(1));
+}
+
+
+
+template<typename T, int dim>
+StatsStore<T, dim> StatsStore<T, dim>::zeroLike() const
+{
+  /**
+   * @return a store of the same size and shift with all statistics zero, used to collect thread-local deltas
+   */
+  StatsStore<T, dim> delta;
+  delta.dimPos_      = dimPos_;
+  delta.directional_ = directional_;
+  delta.shift_       = shift_;
+  delta.refreshEvery_ = refreshEvery_;
+  delta.resize(stats_.size());
+  return delta;
+}
+
+
+
+template<typename T, int dim>
+void StatsStore<T, dim>::add(const row_t &x_i, SuffStats<T,dim> &stats, T sign) const
+{
+  /**
+   * @note plain loops over the centered coordinates, so that no temporary is allocated in the dynamic-size case
+   */
+  stats.count += (sign > 0) ? 1 : -1;
+  for (uint32_t r=0; r<dimPos_; ++r) {
+    T xr = sign * (x_i[r] - shift_[r]);
+    stats.sum[r] += xr;
+    for (uint32_t c=0; c<dimPos_; ++c)
+      stats.outer(r, c) += xr * (x_i[c] - shift_[c]);
+  }
+  if (directional_)
+    for (uint32_t r=0; r<dimPos_; ++r)
+      stats.sumDir[r] += sign * x_i[dimPos_+r];
+}
+
+
+
+template<typename T, int dim>
+void StatsStore<T, dim>::insert(const row_t &x_i, uint32_t k)
+{
+  this ->add(x_i, stats_[k], T(1));
+}
+
+
+
+template<typename T, int dim>
+void StatsStore<T, dim>::move(const row_t &x_i, uint32_t from, uint32_t to)
+{
+  /**
+   * This method moves one observation from component from to component to, at O(d^2) cost
+   */
+  this ->add(x_i, stats_[from], T(-1));
+  this ->add(x_i, stats_[to], T(1));
+}
+
+
+
+template<typename T, int dim>
+void StatsStore<T, dim>::update(const Matrix<T,Dynamic,Dynamic> &x, const VectorXi &zOld, const VectorXi &zNew)
+{
+  /**
+   * This method applies every label change of a sweep, in row order, so that the rounding of the statistics is a
+   * function of the labels only
+   *
+   * @note every refreshEvery_ calls, the statistics are accumulated from scratch out of zNew instead, at the cost of
+   * one pass over x; the sums then carry the rounding of at most refreshEvery_ sweeps of moves instead of piling it
+   * up over the whole run
+   */
+  if (refreshEvery_ > 0 && ++numUpdates_ >= refreshEvery_) {
+    numUpdates_ = 0;
+    for (auto &stats : stats_)
+      stats.setZero(dimPos_);
+    for (uint32_t ii=0; ii<x.rows(); ++ii)
+      this ->add(x.row(ii), stats_[zNew[ii]], T(1));
+    return;
+  }
+
+  for (uint32_t ii=0; ii<x.rows(); ++ii)
+    if (zOld[ii] != zNew[ii])
+      this ->move(x.row(ii), zOld[ii], zNew[ii]);
+}
+
+
+
+template<typename T, int dim>
+void StatsStore<T, dim>::reduce(std::vector<StatsStore<T,dim>> &parts, const ExecutionContext &exec)
+{
+  /**
+   * This function sums all the stores into parts[0] with a pairwise tree, i.e. log2(parts.size()) rounds in which the
+   * pairs are merged in parallel
+   */
+  for (size_t stride=1; stride<parts.size(); stride*=2) {
+    const int64_t numPairs = (parts.size() + 2*stride - 1) / (2*stride);
+    #pragma omp parallel for num_threads(exec.threadsFor(numPairs)) schedule(static)
+    for (int64_t pp=0; pp<numPairs; ++pp) {
+      size_t ii = pp * 2 * stride;
+      if (ii + stride < parts.size())
+        parts[ii].accumulate(parts[ii + stride]);
+    }
+  }
+}
+
+
+
+template<typename T, int dim>
+void StatsStore<T, dim>::accumulate(const StatsStore<T,dim> &delta)
+{
+  for (uint32_t kk=0; kk<stats_.size(); ++kk) {
+    stats_[kk].count  += delta.stats_[kk].count;
+    stats_[kk].sum    += delta.stats_[kk].sum;
+    stats_[kk].outer  += delta.stats_[kk].outer;
+    stats_[kk].sumDir += delta.stats_[kk].sumDir;
+  }
+}
+
+
+
+template<typename T, int dim>
+void StatsStore<T, dim>::select(const std::vector<int> &labels)
+{
+  /**
+   * This method relabels the store such that the new entry k holds the old entry labels[k]; entries that are not
+   * selected are dropped, which mirrors reorderAssignments() and the removal of empty components
+   */
+  std::vector<SuffStats<T,dim>> stats(labels.size());
+  for (uint32_t kk=0; kk<labels.size(); ++kk)
+    stats[kk] = std::move(stats_[labels[kk]]);
+  stats_ = std::move(stats);
+}
+
+
+
+template<typename T, int dim>
+void StatsStore<T, dim>::merge(uint32_t from, uint32_t to)
+{
+  stats_[to].count  += stats_[from].count;
+  stats_[to].sum    += stats_[from].sum;
+  stats_[to].outer  += stats_[from].outer;
+  stats_[to].sumDir += stats_[from].sumDir;
+  stats_[from].setZero(dimPos_);
+}
+
+
+
+template<typename T, int dim>
+void StatsStore<T, dim>::resize(uint32_t K)
+{
+  uint32_t K_old = stats_.size();
+  stats_.resize(K);
+  for (uint32_t kk=K_old; kk<K; ++kk)
+    stats_[kk].setZero(dimPos_);
+}
+
+
+
+
+template struct SuffStats<double>;
+template struct SuffStats<double, 2>;
+template struct SuffStats<double, 3>;
+template struct SuffStats<double, 4>;
+template struct SuffStats<double, 6>;
+
+template class StatsStore<double>;
+template class StatsStore<double, 2>;
+template class StatsStore<double, 3>;
+template class StatsStore<double, 4>;
+template class StatsStore<double, 6>;